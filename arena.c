@@ -0,0 +1,87 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void arena_init(struct arena * arena) {
+    arena->first = NULL;
+    arena->last = NULL;
+}
+
+void arena_destroy(struct arena * arena) {
+    struct arena_block * block = arena->last;
+
+    while (block) {
+        struct arena_block * prev = block->prev;
+
+        free(block);
+        block = prev;
+    }
+
+    arena->first = NULL;
+    arena->last = NULL;
+}
+
+void * arena_alloc(struct arena * arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    struct arena_block * block = arena->last;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+        block = malloc(sizeof(*block) + block_size);
+        block->prev = arena->last;
+        block->size = block_size;
+        block->used = 0;
+
+        if (!arena->first) {
+            arena->first = block;
+        }
+
+        arena->last = block;
+    }
+
+    void * pointer = block->data + block->used;
+    block->used += size;
+    return pointer;
+}
+
+void * arena_calloc(struct arena * arena, size_t amount, size_t size) {
+    void * pointer = arena_alloc(arena, amount * size);
+
+    memset(pointer, 0, amount * size);
+    return pointer;
+}
+
+char * arena_strdup(struct arena * arena, const char * str) {
+    size_t length = strlen(str) + 1;
+    char * copy = arena_alloc(arena, length);
+
+    memcpy(copy, str, length);
+    return copy;
+}
+
+struct arena_mark arena_mark(struct arena * arena) {
+    return (struct arena_mark) {
+        .block = arena->last,
+        .used = arena->last ? arena->last->used : 0,
+    };
+}
+
+void arena_rewind(struct arena * arena, struct arena_mark mark) {
+    // the first block is kept even if it was allocated after the mark
+    while (arena->last != mark.block && arena->last != arena->first) {
+        struct arena_block * prev = arena->last->prev;
+
+        free(arena->last);
+        arena->last = prev;
+    }
+
+    if (arena->last) {
+        arena->last->used = arena->last == mark.block ? mark.used : 0;
+    }
+}
+
+void arena_reset(struct arena * arena) {
+    arena_rewind(arena, (struct arena_mark) { .block = arena->first, .used = 0 });
+}
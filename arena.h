@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Arena allocator:
+// - Memory is handed out from blocks of ARENA_BLOCK_SIZE bytes by bumping the offset of the
+//   current block, allocations larger than a block get a block of their own
+// - Allocations are never freed one by one, arena_reset releases all of them at once and
+//   keeps the first block for the next use
+// - arena_rewind releases everything allocated after arena_mark, so a loop may reuse the
+//   same memory on every iteration
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct arena_block {
+    struct arena_block * prev;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGNMENT) uint8_t data[];
+};
+
+struct arena {
+    struct arena_block * first;
+    struct arena_block * last;
+};
+
+struct arena_mark {
+    struct arena_block * block;
+    size_t used;
+};
+
+void arena_init(struct arena * arena);
+void arena_destroy(struct arena * arena);
+
+void * arena_alloc(struct arena * arena, size_t size);
+void * arena_calloc(struct arena * arena, size_t amount, size_t size);
+char * arena_strdup(struct arena * arena, const char * str);
+
+struct arena_mark arena_mark(struct arena * arena);
+void arena_rewind(struct arena * arena, struct arena_mark mark);
+void arena_reset(struct arena * arena);
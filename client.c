@@ -119,6 +119,18 @@ static void print_table_response(struct json_object * response) {
     print_table_separator(columns_length, columns_width);
 }
 
+static void print_stats_response(struct json_object * response) {
+    json_object_object_foreach(response, key, val) {
+        if (strcmp("rows", key) == 0) {
+            printf("Table has %lu rows.\n", json_object_get_uint64(val));
+            print_table_response(response);
+            return;
+        }
+    }
+
+    printf("Bad answer: %s\n", json_object_to_json_string_ext(response, JSON_C_TO_STRING_PRETTY));
+}
+
 static void print_response(enum json_api_action action, struct json_object * response) {
     if (!response) {
         printf("Server didn't understand request.\n");
@@ -144,7 +156,7 @@ static void print_response(enum json_api_action action, struct json_object * res
             break;
 
         case JSON_API_TYPE_INSERT:
-            printf("Row was inserted.\n");
+            print_amount_response(response, "inserted");
             break;
 
         case JSON_API_TYPE_DELETE:
@@ -159,6 +171,18 @@ static void print_response(enum json_api_action action, struct json_object * res
             print_amount_response(response, "updated");
             break;
 
+        case JSON_API_TYPE_VACUUM:
+            printf("Table was vacuumed.\n");
+            break;
+
+        case JSON_API_TYPE_CREATE_INDEX:
+            printf("Index was created.\n");
+            break;
+
+        case JSON_API_TYPE_STATS:
+            print_stats_response(response);
+            break;
+
         default:
             return;
     }
@@ -13,25 +13,27 @@ enum json_api_action json_api_get_action(struct json_object * object) {
     return -1;
 }
 
-struct json_api_create_table_request json_api_to_create_table_request(struct json_object * object) {
+struct json_api_create_table_request json_api_to_create_table_request(struct json_object * object, struct arena * arena) {
     struct json_api_create_table_request request;
+    request.format = STORAGE_TABLE_FORMAT_ROWS;
 
     json_object_object_foreach(object, key, val) {
         if (strcmp("table", key) == 0) {
-            request.table_name = strdup(json_object_get_string(val));
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
             continue;
         }
 
         if (strcmp("columns", key) == 0) {
             request.columns.amount = json_object_array_length(val);
-            request.columns.columns = malloc(sizeof(*request.columns.columns) * request.columns.amount);
+            request.columns.columns = arena_alloc(arena, sizeof(*request.columns.columns) * request.columns.amount);
 
             for (int i = 0; i < request.columns.amount; ++i) {
                 struct json_object * elem = json_object_array_get_idx(val, i);
+                request.columns.columns[i].dictionary = false;
 
                 json_object_object_foreach(elem, elem_key, elem_val) {
                     if (strcmp("name", elem_key) == 0) {
-                        request.columns.columns[i].name = strdup(json_object_get_string(elem_val));
+                        request.columns.columns[i].name = arena_strdup(arena, json_object_get_string(elem_val));
                         continue;
                     }
 
@@ -39,23 +41,33 @@ struct json_api_create_table_request json_api_to_create_table_request(struct jso
                         request.columns.columns[i].type = (enum storage_column_type) json_object_get_int(elem_val);
                         continue;
                     }
+
+                    if (strcmp("dictionary", elem_key) == 0) {
+                        request.columns.columns[i].dictionary = json_object_get_boolean(elem_val);
+                        continue;
+                    }
                 }
             }
 
             continue;
         }
+
+        if (strcmp("format", key) == 0) {
+            request.format = (enum storage_table_format) json_object_get_int(val);
+            continue;
+        }
     }
 
     return request;
 }
 
-struct json_api_drop_table_request json_api_to_drop_table_request(struct json_object * object) {
+struct json_api_drop_table_request json_api_to_drop_table_request(struct json_object * object, struct arena * arena) {
     struct json_api_drop_table_request request;
     request.table_name = NULL;
 
     json_object_object_foreach(object, key, val) {
         if (strcmp("table", key) == 0) {
-            request.table_name = strdup(json_object_get_string(val));
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
             break;
         }
     }
@@ -63,7 +75,7 @@ struct json_api_drop_table_request json_api_to_drop_table_request(struct json_ob
     return request;
 }
 
-static struct storage_value * json_to_storage_value(struct json_object * object) {
+static struct storage_value * json_to_storage_value(struct json_object * object, struct arena * arena) {
     struct storage_value * value;
 
     switch (json_object_get_type(object)) {
@@ -76,13 +88,13 @@ static struct storage_value * json_to_storage_value(struct json_object * object)
             return NULL;
 
         case json_type_double:
-            value = malloc(sizeof(*value));
+            value = arena_alloc(arena, sizeof(*value));
             value->type = STORAGE_COLUMN_TYPE_NUM;
             value->value.num = json_object_get_double(object);
             break;
 
         case json_type_int:
-            value = malloc(sizeof(*value));
+            value = arena_alloc(arena, sizeof(*value));
             value->value._int = json_object_get_int64(object);
 
             if (value->value._int < 0) {
@@ -95,44 +107,62 @@ static struct storage_value * json_to_storage_value(struct json_object * object)
             break;
 
         case json_type_string:
-            value = malloc(sizeof(*value));
+            value = arena_alloc(arena, sizeof(*value));
             value->type = STORAGE_COLUMN_TYPE_STR;
-            value->value.str = strdup(json_object_get_string(object));
+            value->value.str = arena_strdup(arena, json_object_get_string(object));
             break;
     }
 
     return value;
 }
 
-struct json_api_insert_request json_api_to_insert_request(struct json_object * object) {
+static void json_api_to_values(struct json_object * object, unsigned int * amount, struct storage_value *** values, struct arena * arena) {
+    *amount = json_object_array_length(object);
+    *values = arena_alloc(arena, sizeof(struct storage_value *) * *amount);
+
+    for (int i = 0; i < *amount; ++i) {
+        (*values)[i] = json_to_storage_value(json_object_array_get_idx(object, i), arena);
+    }
+}
+
+struct json_api_insert_request json_api_to_insert_request(struct json_object * object, struct arena * arena) {
     struct json_api_insert_request request;
 
     request.columns.amount = 0;
     request.columns.columns = NULL;
+    request.rows.amount = 0;
+    request.rows.rows = NULL;
 
     json_object_object_foreach(object, key, val) {
         if (strcmp("table", key) == 0) {
-            request.table_name = strdup(json_object_get_string(val));
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
             continue;
         }
 
         if (strcmp("columns", key) == 0) {
             request.columns.amount = json_object_array_length(val);
-            request.columns.columns = malloc(sizeof(*request.columns.columns) * request.columns.amount);
+            request.columns.columns = arena_alloc(arena, sizeof(*request.columns.columns) * request.columns.amount);
 
             for (int i = 0; i < request.columns.amount; ++i) {
-                request.columns.columns[i] = strdup(json_object_get_string(json_object_array_get_idx(val, i)));
+                request.columns.columns[i] = arena_strdup(arena, json_object_get_string(json_object_array_get_idx(val, i)));
             }
 
             continue;
         }
 
         if (strcmp("values", key) == 0) {
-            request.values.amount = json_object_array_length(val);
-            request.values.values = malloc(sizeof(struct storage_value *) * request.values.amount);
+            request.rows.amount = 1;
+            request.rows.rows = arena_alloc(arena, sizeof(*request.rows.rows));
+            json_api_to_values(val, &request.rows.rows[0].amount, &request.rows.rows[0].values, arena);
+            continue;
+        }
 
-            for (int i = 0; i < request.values.amount; ++i) {
-                request.values.values[i] = json_to_storage_value(json_object_array_get_idx(val, i));
+        if (strcmp("rows", key) == 0) {
+            request.rows.amount = json_object_array_length(val);
+            request.rows.rows = arena_alloc(arena, sizeof(*request.rows.rows) * request.rows.amount);
+
+            for (int i = 0; i < request.rows.amount; ++i) {
+                json_api_to_values(json_object_array_get_idx(val, i), &request.rows.rows[i].amount, &request.rows.rows[i].values, arena);
             }
 
             continue;
@@ -142,8 +172,8 @@ struct json_api_insert_request json_api_to_insert_request(struct json_object * o
     return request;
 }
 
-static struct json_api_where * json_api_to_where(struct json_object * object) {
-    struct json_api_where * where = malloc(sizeof(*where));
+static struct json_api_where * json_api_to_where(struct json_object * object, struct arena * arena) {
+    struct json_api_where * where = arena_alloc(arena, sizeof(*where));
 
     {
         json_object_object_foreach(object, key, val) {
@@ -164,12 +194,12 @@ static struct json_api_where * json_api_to_where(struct json_object * object) {
         {
             json_object_object_foreach(object, key, val) {
                 if (strcmp("column", key) == 0) {
-                    where->column = strdup(json_object_get_string(val));
+                    where->column = arena_strdup(arena, json_object_get_string(val));
                     continue;
                 }
 
                 if (strcmp("value", key) == 0) {
-                    where->value = json_to_storage_value(val);
+                    where->value = json_to_storage_value(val, arena);
                     continue;
                 }
             }
@@ -182,12 +212,12 @@ static struct json_api_where * json_api_to_where(struct json_object * object) {
         {
             json_object_object_foreach(object, key, val) {
                 if (strcmp("left", key) == 0) {
-                    where->left = json_api_to_where(val);
+                    where->left = json_api_to_where(val, arena);
                     continue;
                 }
 
                 if (strcmp("right", key) == 0) {
-                    where->right = json_api_to_where(val);
+                    where->right = json_api_to_where(val, arena);
                     continue;
                 }
             }
@@ -199,18 +229,18 @@ static struct json_api_where * json_api_to_where(struct json_object * object) {
     return where;
 }
 
-struct json_api_delete_request json_api_to_delete_request(struct json_object * object) {
+struct json_api_delete_request json_api_to_delete_request(struct json_object * object, struct arena * arena) {
     struct json_api_delete_request request;
     request.where = NULL;
 
     json_object_object_foreach(object, key, val) {
         if (strcmp("table", key) == 0) {
-            request.table_name = strdup(json_object_get_string(val));
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
             continue;
         }
 
         if (strcmp("where", key) == 0) {
-            request.where = json_api_to_where(val);
+            request.where = json_api_to_where(val, arena);
             continue;
         }
     }
@@ -218,7 +248,7 @@ struct json_api_delete_request json_api_to_delete_request(struct json_object * o
     return request;
 }
 
-struct json_api_select_request json_api_to_select_request(struct json_object * object) {
+struct json_api_select_request json_api_to_select_request(struct json_object * object, struct arena * arena) {
     struct json_api_select_request request;
     request.columns.amount = 0;
     request.columns.columns = NULL;
@@ -230,23 +260,23 @@ struct json_api_select_request json_api_to_select_request(struct json_object * o
 
     json_object_object_foreach(object, key, val) {
         if (strcmp("table", key) == 0) {
-            request.table_name = strdup(json_object_get_string(val));
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
             continue;
         }
 
         if (strcmp("columns", key) == 0) {
             request.columns.amount = json_object_array_length(val);
-            request.columns.columns = malloc(sizeof(*request.columns.columns) * request.columns.amount);
+            request.columns.columns = arena_alloc(arena, sizeof(*request.columns.columns) * request.columns.amount);
 
             for (int i = 0; i < request.columns.amount; ++i) {
-                request.columns.columns[i] = strdup(json_object_get_string(json_object_array_get_idx(val, i)));
+                request.columns.columns[i] = arena_strdup(arena, json_object_get_string(json_object_array_get_idx(val, i)));
             }
 
             continue;
         }
 
         if (strcmp("where", key) == 0) {
-            request.where = json_api_to_where(val);
+            request.where = json_api_to_where(val, arena);
             continue;
         }
 
@@ -262,22 +292,22 @@ struct json_api_select_request json_api_to_select_request(struct json_object * o
 
         if (strcmp("joins", key) == 0) {
             request.joins.amount = json_object_array_length(val);
-            request.joins.joins = malloc(sizeof(*request.joins.joins) * request.joins.amount);
+            request.joins.joins = arena_alloc(arena, sizeof(*request.joins.joins) * request.joins.amount);
 
             for (int i = 0; i < request.joins.amount; ++i) {
                 struct json_object * elem = json_object_array_get_idx(val, i);
 
                 json_object_object_foreach(elem, elem_key, elem_val) {
                     if (strcmp("table", elem_key) == 0) {
-                        request.joins.joins[i].table = strdup(json_object_get_string(elem_val));
+                        request.joins.joins[i].table = arena_strdup(arena, json_object_get_string(elem_val));
                     }
 
                     if (strcmp("t_column", elem_key) == 0) {
-                        request.joins.joins[i].t_column = strdup(json_object_get_string(elem_val));
+                        request.joins.joins[i].t_column = arena_strdup(arena, json_object_get_string(elem_val));
                     }
 
                     if (strcmp("s_column", elem_key) == 0) {
-                        request.joins.joins[i].s_column = strdup(json_object_get_string(elem_val));
+                        request.joins.joins[i].s_column = arena_strdup(arena, json_object_get_string(elem_val));
                     }
                 }
             }
@@ -289,22 +319,22 @@ struct json_api_select_request json_api_to_select_request(struct json_object * o
     return request;
 }
 
-struct json_api_update_request json_api_to_update_request(struct json_object * object) {
+struct json_api_update_request json_api_to_update_request(struct json_object * object, struct arena * arena) {
     struct json_api_update_request request;
     request.where = NULL;
 
     json_object_object_foreach(object, key, val) {
         if (strcmp("table", key) == 0) {
-            request.table_name = strdup(json_object_get_string(val));
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
             continue;
         }
 
         if (strcmp("columns", key) == 0) {
             request.columns.amount = json_object_array_length(val);
-            request.columns.columns = malloc(sizeof(*request.columns.columns) * request.columns.amount);
+            request.columns.columns = arena_alloc(arena, sizeof(*request.columns.columns) * request.columns.amount);
 
             for (int i = 0; i < request.columns.amount; ++i) {
-                request.columns.columns[i] = strdup(json_object_get_string(json_object_array_get_idx(val, i)));
+                request.columns.columns[i] = arena_strdup(arena, json_object_get_string(json_object_array_get_idx(val, i)));
             }
 
             continue;
@@ -312,17 +342,63 @@ struct json_api_update_request json_api_to_update_request(struct json_object * o
 
         if (strcmp("values", key) == 0) {
             request.values.amount = json_object_array_length(val);
-            request.values.values = malloc(sizeof(struct storage_value *) * request.values.amount);
+            request.values.values = arena_alloc(arena, sizeof(struct storage_value *) * request.values.amount);
 
             for (int i = 0; i < request.values.amount; ++i) {
-                request.values.values[i] = json_to_storage_value(json_object_array_get_idx(val, i));
+                request.values.values[i] = json_to_storage_value(json_object_array_get_idx(val, i), arena);
             }
 
             continue;
         }
 
         if (strcmp("where", key) == 0) {
-            request.where = json_api_to_where(val);
+            request.where = json_api_to_where(val, arena);
+            continue;
+        }
+    }
+
+    return request;
+}
+
+struct json_api_vacuum_request json_api_to_vacuum_request(struct json_object * object, struct arena * arena) {
+    struct json_api_vacuum_request request;
+    request.table_name = NULL;
+
+    json_object_object_foreach(object, key, val) {
+        if (strcmp("table", key) == 0) {
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
+            break;
+        }
+    }
+
+    return request;
+}
+
+struct json_api_create_index_request json_api_to_create_index_request(struct json_object * object, struct arena * arena) {
+    struct json_api_create_index_request request;
+    request.index_name = NULL;
+    request.table_name = NULL;
+    request.column = NULL;
+    request.type = STORAGE_INDEX_TYPE_BTREE;
+
+    json_object_object_foreach(object, key, val) {
+        if (strcmp("index", key) == 0) {
+            request.index_name = arena_strdup(arena, json_object_get_string(val));
+            continue;
+        }
+
+        if (strcmp("table", key) == 0) {
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
+            continue;
+        }
+
+        if (strcmp("column", key) == 0) {
+            request.column = arena_strdup(arena, json_object_get_string(val));
+            continue;
+        }
+
+        if (strcmp("type", key) == 0) {
+            request.type = (enum storage_index_type) json_object_get_int(val);
             continue;
         }
     }
@@ -344,6 +420,20 @@ struct json_object * json_api_make_error(const char * msg) {
     return object;
 }
 
+struct json_api_stats_request json_api_to_stats_request(struct json_object * object, struct arena * arena) {
+    struct json_api_stats_request request;
+    request.table_name = NULL;
+
+    json_object_object_foreach(object, key, val) {
+        if (strcmp("table", key) == 0) {
+            request.table_name = arena_strdup(arena, json_object_get_string(val));
+            break;
+        }
+    }
+
+    return request;
+}
+
 struct json_object * json_api_from_value(struct storage_value * value) {
     if (value == NULL) {
         return NULL;
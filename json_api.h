@@ -3,8 +3,9 @@
 #include <json-c/json.h>
 
 #include "storage.h"
+#include "arena.h"
 
-// request object: { "action": <action: 0/1/2/3/4/5>, ... }
+// request object: { "action": <action: 0/1/2/3/4/5/6/7/8>, ... }
 // response object: { ["success": ...,] ["error": <error message: string>,] }
 //
 // action "create table" (0):
@@ -15,8 +16,10 @@
 //         {
 //             "name": <column name: string>,
 //             "type": <column type: 0/1/2/3>,
+//             ["dictionary": <encode strings with a dictionary (default false): boolean>,]
 //         },
 //     ],
+//     ["format": <table format (default 0): 0 - rows, 1 - columnar>,]
 // }
 // - success response: {}
 //
@@ -33,8 +36,11 @@
 //     "table": <table name: string>,
 //     ["columns": <column names: string[]>,]
 //     "values": <values list: <string/number/null>[]>,
+//     or "rows": <values lists of rows: <string/number/null>[][]>,
+// }
+// - success response: {
+//     "amount": <amount of inserted rows: number>
 // }
-// - success response: {}
 //
 // action "delete" (3):
 // - request: {
@@ -79,6 +85,35 @@
 //     "amount": <amount of updated rows: number>
 // }
 //
+// action "vacuum" (6):
+// - request: {
+//     "action": 6,
+//     "table": <table name: string>,
+// }
+// - success response: {}
+//
+// action "create index" (7):
+// - request: {
+//     "action": 7,
+//     "index": <index name: string>,
+//     "table": <table name: string>,
+//     "column": <column name: string>,
+//     ["type": <index type: 0/1 - btree/hash>,]
+// }
+// - success response: {}
+//
+// action "stats" (8):
+// - request: {
+//     "action": 8,
+//     "table": <table name: string>,
+// }
+// - success response: {
+//     "rows": <amount of rows: number>,
+//     "columns": ["column", "nulls", "min", "max", "distinct"],
+//     "values": <stats of columns: [<name: string>, <amount of NULL values: number>,
+//         <min: number/null>, <max: number/null>, <estimated amount of distinct values: number>][]>
+// }
+//
 // where expression object: { "op": <operator: 0/1/2/3/4/5/6/7 - eq/ne/lt/gt/le/ge/and/or>, ... }
 //
 // where operators "eq"/"ne"/"lt"/"gt"/"le"/"ge" (0/1/2/3/4/5): {
@@ -92,6 +127,9 @@
 //     "left": <where expression>,
 //     "right": <where expression>,
 // }
+//
+// Parsed requests with all their names, values and where expressions are allocated in the arena
+// passed to json_api_to_*_request and stay valid until the arena is reset.
 
 enum json_api_action {
     JSON_API_TYPE_CREATE_TABLE = 0,
@@ -100,6 +138,9 @@ enum json_api_action {
     JSON_API_TYPE_DELETE = 3,
     JSON_API_TYPE_SELECT = 4,
     JSON_API_TYPE_UPDATE = 5,
+    JSON_API_TYPE_VACUUM = 6,
+    JSON_API_TYPE_CREATE_INDEX = 7,
+    JSON_API_TYPE_STATS = 8,
 };
 
 struct json_api_create_table_request {
@@ -109,8 +150,10 @@ struct json_api_create_table_request {
         struct {
             char * name;
             enum storage_column_type type;
+            bool dictionary;
         } * columns;
     } columns;
+    enum storage_table_format format;
 };
 
 struct json_api_drop_table_request {
@@ -125,8 +168,11 @@ struct json_api_insert_request {
     } columns;
     struct {
         unsigned int amount;
-        struct storage_value ** values;
-    } values;
+        struct {
+            unsigned int amount;
+            struct storage_value ** values;
+        } * rows;
+    } rows;
 };
 
 enum json_api_operator {
@@ -193,14 +239,32 @@ struct json_api_update_request {
     struct json_api_where * where;
 };
 
+struct json_api_vacuum_request {
+    char * table_name;
+};
+
+struct json_api_create_index_request {
+    char * index_name;
+    char * table_name;
+    char * column;
+    enum storage_index_type type;
+};
+
+struct json_api_stats_request {
+    char * table_name;
+};
+
 enum json_api_action json_api_get_action(struct json_object * object);
 
-struct json_api_create_table_request json_api_to_create_table_request(struct json_object * object);
-struct json_api_drop_table_request json_api_to_drop_table_request(struct json_object * object);
-struct json_api_insert_request json_api_to_insert_request(struct json_object * object);
-struct json_api_delete_request json_api_to_delete_request(struct json_object * object);
-struct json_api_select_request json_api_to_select_request(struct json_object * object);
-struct json_api_update_request json_api_to_update_request(struct json_object * object);
+struct json_api_create_table_request json_api_to_create_table_request(struct json_object * object, struct arena * arena);
+struct json_api_drop_table_request json_api_to_drop_table_request(struct json_object * object, struct arena * arena);
+struct json_api_insert_request json_api_to_insert_request(struct json_object * object, struct arena * arena);
+struct json_api_delete_request json_api_to_delete_request(struct json_object * object, struct arena * arena);
+struct json_api_select_request json_api_to_select_request(struct json_object * object, struct arena * arena);
+struct json_api_update_request json_api_to_update_request(struct json_object * object, struct arena * arena);
+struct json_api_vacuum_request json_api_to_vacuum_request(struct json_object * object, struct arena * arena);
+struct json_api_create_index_request json_api_to_create_index_request(struct json_object * object, struct arena * arena);
+struct json_api_stats_request json_api_to_stats_request(struct json_object * object, struct arena * arena);
 
 struct json_object * json_api_make_success(struct json_object * answer);
 struct json_object * json_api_make_error(const char * msg);
@@ -0,0 +1,691 @@
+#define _FILE_OFFSET_BITS 64
+
+#include "pager.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#ifdef PLATFORM_MACOS
+#define fdatasync(handle) fsync(handle) // macos
+#define posix_fadvise(handle,offset,length,advice) 0 // macos
+#endif
+
+#define PAGER_WAL_SIGNATURE 0xfeedface
+#define PAGER_WAL_VERSION 1
+
+struct pager_wal_header {
+    uint32_t signature;
+    uint32_t version;
+    uint64_t salt;
+};
+
+struct pager_wal_frame {
+    uint64_t number;
+    uint64_t size;
+    uint64_t salt;
+    uint64_t checksum;
+};
+
+static uint64_t pager_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+static uint64_t pager_wal_checksum(uint64_t checksum, const void * data, size_t length) {
+    const uint8_t * bytes = data;
+
+    for (size_t i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+
+        checksum = (checksum ^ word) * 0x100000001b3ULL;
+    }
+
+    return checksum;
+}
+
+static uint64_t pager_wal_get_frame(struct pager * pager, uint64_t number) {
+    return number < pager->wal.pages.amount ? pager->wal.pages.frames[number] : 0;
+}
+
+static void pager_wal_set_frame(struct pager * pager, uint64_t number, uint64_t frame) {
+    if (number >= pager->wal.pages.amount) {
+        uint64_t amount = pager->wal.pages.amount > 0 ? pager->wal.pages.amount : 64;
+        while (amount <= number) {
+            amount *= 2;
+        }
+
+        pager->wal.pages.frames = realloc(pager->wal.pages.frames, sizeof(*pager->wal.pages.frames) * amount);
+        memset(pager->wal.pages.frames + pager->wal.pages.amount, 0,
+            sizeof(*pager->wal.pages.frames) * (amount - pager->wal.pages.amount));
+
+        pager->wal.pages.amount = amount;
+    }
+
+    pager->wal.pages.frames[number] = frame;
+}
+
+// Starts the log again with a new salt
+static void pager_wal_restart(struct pager * pager) {
+    struct pager_wal_header header = {
+        .signature = PAGER_WAL_SIGNATURE,
+        .version = PAGER_WAL_VERSION,
+        .salt = pager->wal.salt + 1,
+    };
+
+    pwrite(pager->wal.fd, &header, sizeof(header), 0);
+    ftruncate(pager->wal.fd, sizeof(header));
+    fdatasync(pager->wal.fd);
+
+    pager->wal.salt = header.salt;
+    pager->wal.checksum = header.salt;
+    pager->wal.size = sizeof(header);
+    pager->wal.frames = 0;
+    pager->wal.pending = false;
+
+    if (pager->wal.pages.amount > 0) {
+        memset(pager->wal.pages.frames, 0, sizeof(*pager->wal.pages.frames) * pager->wal.pages.amount);
+    }
+}
+
+// Appends frames of the pages to the log, the last one is marked as commit if it is specified
+static void pager_wal_append(struct pager * pager, struct pager_page ** pages, size_t amount, bool commit) {
+    struct pager_wal_frame frames[PAGER_FLUSH_RUN];
+    struct iovec vectors[2 * PAGER_FLUSH_RUN];
+
+    for (size_t i = 0; i < amount;) {
+        uint64_t offset = pager->wal.size;
+        int count = 0;
+
+        for (; i < amount && count < PAGER_FLUSH_RUN; ++i, ++count) {
+            struct pager_wal_frame * frame = &frames[count];
+
+            frame->number = pages[i]->number;
+            frame->size = commit && i == amount - 1 ? pager->size : 0;
+            frame->salt = pager->wal.salt;
+
+            pager->wal.checksum = pager_wal_checksum(pager->wal.checksum, frame, offsetof(struct pager_wal_frame, checksum));
+            pager->wal.checksum = pager_wal_checksum(pager->wal.checksum, pages[i]->data, PAGER_PAGE_SIZE);
+            frame->checksum = pager->wal.checksum;
+
+            vectors[2 * count].iov_base = frame;
+            vectors[2 * count].iov_len = sizeof(*frame);
+            vectors[2 * count + 1].iov_base = pages[i]->data;
+            vectors[2 * count + 1].iov_len = PAGER_PAGE_SIZE;
+
+            pager_wal_set_frame(pager, frame->number, pager->wal.size + sizeof(*frame));
+            pager->wal.size += sizeof(*frame) + PAGER_PAGE_SIZE;
+            ++pager->wal.frames;
+            pages[i]->dirty = false;
+        }
+
+        pwritev(pager->wal.fd, vectors, 2 * count, (off_t) offset);
+    }
+
+    pager->wal.pending = !commit;
+}
+
+static struct pager_page * pager_lookup(struct pager * pager, uint64_t number) {
+    if (pager->map.amount == 0) {
+        return NULL;
+    }
+
+    for (long index = pager->map.buckets[number % pager->map.amount]; index >= 0; index = pager->frames.pages[index].next) {
+        if (pager->frames.pages[index].number == number) {
+            return &pager->frames.pages[index];
+        }
+    }
+
+    return NULL;
+}
+
+// Copies the latest frames of the log to the storage file and starts the log again
+static void pager_wal_checkpoint(struct pager * pager) {
+    if (pager->wal.frames == 0) {
+        return;
+    }
+
+    // frames must be on disk before the storage file is changed
+    fdatasync(pager->wal.fd);
+
+    uint8_t data[PAGER_PAGE_SIZE];
+    for (uint64_t number = 0; number < pager->wal.pages.amount; ++number) {
+        uint64_t frame = pager->wal.pages.frames[number];
+        uint64_t offset = number * PAGER_PAGE_SIZE;
+
+        if (frame == 0 || offset >= pager->size) {
+            continue;
+        }
+
+        size_t length = pager->size - offset < PAGER_PAGE_SIZE ? pager->size - offset : PAGER_PAGE_SIZE;
+
+        // a clean cached page is the same as its latest frame
+        struct pager_page * page = pager_lookup(pager, number);
+        if (page && !page->dirty) {
+            pwrite(pager->fd, page->data, length, (off_t) offset);
+            continue;
+        }
+
+        pread(pager->wal.fd, data, length, (off_t) frame);
+        pwrite(pager->fd, data, length, (off_t) offset);
+    }
+
+    fdatasync(pager->fd);
+    pager_wal_restart(pager);
+}
+
+// Replays committed frames left in the log by a checkpoint
+static void pager_wal_recover(struct pager * pager) {
+    struct pager_wal_header header;
+    uint64_t started_at = pager_now();
+    pager->wal.salt = (uint64_t) time(NULL);
+
+    if (pread(pager->wal.fd, &header, sizeof(header), 0) != sizeof(header)
+        || header.signature != PAGER_WAL_SIGNATURE || header.version != PAGER_WAL_VERSION) {
+
+        pager_wal_restart(pager);
+        return;
+    }
+
+    // the log ends at the last frame which commits valid frames
+    uint64_t checksum = header.salt;
+    uint64_t offset = sizeof(header), end = offset, size = 0;
+
+    struct pager_wal_frame frame;
+    uint8_t data[PAGER_PAGE_SIZE];
+
+    while (pread(pager->wal.fd, &frame, sizeof(frame), (off_t) offset) == sizeof(frame)
+        && pread(pager->wal.fd, data, PAGER_PAGE_SIZE, (off_t) (offset + sizeof(frame))) == PAGER_PAGE_SIZE) {
+
+        checksum = pager_wal_checksum(checksum, &frame, offsetof(struct pager_wal_frame, checksum));
+        checksum = pager_wal_checksum(checksum, data, PAGER_PAGE_SIZE);
+
+        if (frame.salt != header.salt || frame.checksum != checksum) {
+            break;
+        }
+
+        offset += sizeof(frame) + PAGER_PAGE_SIZE;
+
+        if (frame.size != 0) {
+            end = offset;
+            size = frame.size;
+        }
+    }
+
+    pager->wal.frames = 0;
+    for (offset = sizeof(header); offset < end; offset += sizeof(frame) + PAGER_PAGE_SIZE) {
+        pread(pager->wal.fd, &frame, sizeof(frame), (off_t) offset);
+        pager_wal_set_frame(pager, frame.number, offset + sizeof(frame));
+        ++pager->wal.frames;
+
+        if (frame.size != 0) {
+            ++pager->wal.recovery.transactions;
+        }
+    }
+
+    pager->wal.salt = header.salt;
+    pager->wal.size = end;
+
+    if (size > 0) {
+        pager->size = size;
+    }
+
+    pager->wal.recovery.frames = pager->wal.frames;
+
+    if (pager->wal.frames > 0) {
+        pager_wal_checkpoint(pager);
+    } else {
+        pager_wal_restart(pager);
+    }
+
+    pager->wal.recovery.time = pager_now() - started_at;
+}
+
+static void pager_mmap_grow(struct pager * pager, uint64_t length) {
+    if (length <= pager->mapping.length) {
+        return;
+    }
+
+    uint64_t new_length = (length + PAGER_MMAP_CHUNK - 1) / PAGER_MMAP_CHUNK * PAGER_MMAP_CHUNK;
+    if (new_length > PAGER_MMAP_RESERVE || ftruncate(pager->fd, (off_t) new_length) != 0) {
+        abort();
+    }
+
+    void * mapped = mmap(pager->mapping.base + pager->mapping.length, new_length - pager->mapping.length,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, pager->fd, (off_t) pager->mapping.length);
+
+    if (mapped == MAP_FAILED) {
+        abort();
+    }
+
+    pager->mapping.length = new_length;
+}
+
+static bool pager_mmap_init(struct pager * pager) {
+    void * reserved = mmap(NULL, PAGER_MMAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (reserved == MAP_FAILED) {
+        return false;
+    }
+
+    pager->mapping.base = reserved;
+    pager->mapping.length = 0;
+    pager_mmap_grow(pager, pager->size > 0 ? pager->size : 1);
+    return true;
+}
+
+struct pager * pager_new(int fd, int wal_fd, enum pager_mode mode, enum pager_durability durability, size_t cache_size) {
+    if (cache_size == 0) {
+        cache_size = PAGER_DEFAULT_CACHE_SIZE;
+    }
+
+    struct pager * pager = malloc(sizeof(*pager));
+    struct stat file;
+
+    pager->fd = fd;
+    pager->mode = mode;
+    pager->size = fstat(fd, &file) == 0 ? (uint64_t) file.st_size : 0;
+    pager->mapping.base = NULL;
+    pager->mapping.length = 0;
+
+    pager->wal.fd = wal_fd;
+    pager->wal.durability = durability;
+    pager->wal.salt = 0;
+    pager->wal.checksum = 0;
+    pager->wal.size = 0;
+    pager->wal.frames = 0;
+    pager->wal.pending = false;
+    pager->wal.pages.amount = 0;
+    pager->wal.pages.frames = NULL;
+    pager->wal.recovery.frames = 0;
+    pager->wal.recovery.transactions = 0;
+    pager->wal.recovery.time = 0;
+
+    // the log is replayed before any page is cached
+    pager->map.amount = 0;
+
+    if (pager->wal.fd >= 0) {
+        pager_wal_recover(pager);
+    }
+
+    if (pager->mode == PAGER_MODE_MMAP && !pager_mmap_init(pager)) {
+        pager->mode = PAGER_MODE_CACHE;
+    }
+
+    // pages of the mapping are written back by the system, so they are not logged
+    if (pager->mode == PAGER_MODE_MMAP) {
+        pager->wal.fd = -1;
+    }
+
+    pager->frames.amount = cache_size;
+    pager->frames.hand = 0;
+    pager->frames.pages = calloc(cache_size, sizeof(*pager->frames.pages));
+
+    // in mmap mode frames only describe pinned pages of the mapping
+    uint8_t * data = pager->mode == PAGER_MODE_CACHE ? malloc(PAGER_PAGE_SIZE * cache_size) : NULL;
+    for (size_t i = 0; i < cache_size; ++i) {
+        pager->frames.pages[i].data = data ? data + PAGER_PAGE_SIZE * i : NULL;
+        pager->frames.pages[i].next = -1;
+    }
+
+    pager->map.amount = cache_size;
+    pager->map.buckets = malloc(sizeof(*pager->map.buckets) * cache_size);
+    for (size_t i = 0; i < cache_size; ++i) {
+        pager->map.buckets[i] = -1;
+    }
+
+    return pager;
+}
+
+void pager_delete(struct pager * pager) {
+    if (pager) {
+        pager_checkpoint(pager);
+
+        if (pager->mode == PAGER_MODE_MMAP) {
+            munmap(pager->mapping.base, PAGER_MMAP_RESERVE);
+            ftruncate(pager->fd, (off_t) pager->size);
+        } else if (pager->frames.amount > 0) {
+            free(pager->frames.pages[0].data);
+        }
+
+        free(pager->frames.pages);
+        free(pager->map.buckets);
+        free(pager->wal.pages.frames);
+    }
+
+    free(pager);
+}
+
+static void pager_write_back(struct pager * pager, struct pager_page * page) {
+    uint64_t offset = page->number * PAGER_PAGE_SIZE;
+
+    // the storage file is changed only by checkpoints
+    if (pager->wal.fd >= 0 && offset < pager->size) {
+        pager_wal_append(pager, &page, 1, false);
+        return;
+    }
+
+    if (pager->mode == PAGER_MODE_CACHE && offset < pager->size) {
+        size_t length = pager->size - offset < PAGER_PAGE_SIZE ? pager->size - offset : PAGER_PAGE_SIZE;
+        pwrite(pager->fd, page->data, length, (off_t) offset);
+    }
+
+    page->dirty = false;
+}
+
+static void pager_load(struct pager * pager, struct pager_page * page) {
+    uint64_t offset = page->number * PAGER_PAGE_SIZE;
+    size_t length = 0;
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        pager_mmap_grow(pager, offset + PAGER_PAGE_SIZE);
+        page->data = pager->mapping.base + offset;
+        return;
+    }
+
+    uint64_t frame = pager_wal_get_frame(pager, page->number);
+    if (frame != 0) {
+        pread(pager->wal.fd, page->data, PAGER_PAGE_SIZE, (off_t) frame);
+        return;
+    }
+
+    if (offset < pager->size) {
+        length = pager->size - offset < PAGER_PAGE_SIZE ? pager->size - offset : PAGER_PAGE_SIZE;
+
+        ssize_t was_read = pread(pager->fd, page->data, length, (off_t) offset);
+        length = was_read > 0 ? (size_t) was_read : 0;
+    }
+
+    memset(page->data + length, 0, PAGER_PAGE_SIZE - length);
+}
+
+static void pager_map_remove(struct pager * pager, long index) {
+    long * link = &pager->map.buckets[pager->frames.pages[index].number % pager->map.amount];
+
+    while (*link != index) {
+        link = &pager->frames.pages[*link].next;
+    }
+
+    *link = pager->frames.pages[index].next;
+    pager->frames.pages[index].next = -1;
+}
+
+static long pager_evict(struct pager * pager) {
+    for (size_t i = 0; i < 2 * pager->frames.amount; ++i) {
+        long index = (long) pager->frames.hand;
+        struct pager_page * page = &pager->frames.pages[index];
+
+        pager->frames.hand = (pager->frames.hand + 1) % pager->frames.amount;
+
+        if (!page->used) {
+            return index;
+        }
+
+        if (page->pins > 0) {
+            continue;
+        }
+
+        if (page->referenced) {
+            page->referenced = false;
+            continue;
+        }
+
+        if (page->dirty) {
+            pager_write_back(pager, page);
+        }
+
+        pager_map_remove(pager, index);
+        page->used = false;
+        return index;
+    }
+
+    // every frame is pinned
+    abort();
+}
+
+struct pager_page * pager_pin(struct pager * pager, uint64_t number) {
+    long * bucket = &pager->map.buckets[number % pager->map.amount];
+    struct pager_page * found = pager_lookup(pager, number);
+
+    if (found) {
+        ++found->pins;
+        found->referenced = true;
+
+        return found;
+    }
+
+    long index = pager_evict(pager);
+    struct pager_page * page = &pager->frames.pages[index];
+
+    page->number = number;
+    page->pins = 1;
+    page->dirty = false;
+    page->referenced = true;
+    page->used = true;
+    pager_load(pager, page);
+
+    page->next = *bucket;
+    *bucket = index;
+
+    return page;
+}
+
+void pager_unpin(struct pager * pager, struct pager_page * page, bool dirty) {
+    page->dirty = page->dirty || dirty;
+    --page->pins;
+}
+
+void pager_read(struct pager * pager, uint64_t offset, void * buf, size_t length) {
+    uint8_t * dst = buf;
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        pager_mmap_grow(pager, offset + length);
+
+        memcpy(dst, pager->mapping.base + offset, length);
+        return;
+    }
+
+    while (length > 0) {
+        size_t in_page = offset % PAGER_PAGE_SIZE;
+        size_t chunk = PAGER_PAGE_SIZE - in_page < length ? PAGER_PAGE_SIZE - in_page : length;
+
+        struct pager_page * page = pager_pin(pager, offset / PAGER_PAGE_SIZE);
+        memcpy(dst, page->data + in_page, chunk);
+        pager_unpin(pager, page, false);
+
+        dst += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+}
+
+void pager_write(struct pager * pager, uint64_t offset, const void * buf, size_t length) {
+    const uint8_t * src = buf;
+
+    if (offset + length > pager->size) {
+        pager->size = offset + length;
+    }
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        pager_mmap_grow(pager, offset + length);
+        memcpy(pager->mapping.base + offset, src, length);
+
+        return;
+    }
+
+    while (length > 0) {
+        size_t in_page = offset % PAGER_PAGE_SIZE;
+        size_t chunk = PAGER_PAGE_SIZE - in_page < length ? PAGER_PAGE_SIZE - in_page : length;
+
+        struct pager_page * page = pager_pin(pager, offset / PAGER_PAGE_SIZE);
+        memcpy(page->data + in_page, src, chunk);
+        pager_unpin(pager, page, true);
+
+        src += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+}
+
+// Asks the kernel to start reading the range of the file or the log in the background
+static void pager_advise(int fd, uint64_t offset, uint64_t length) {
+    if (length > 0) {
+        posix_fadvise(fd, (off_t) offset, (off_t) length, POSIX_FADV_WILLNEED);
+    }
+}
+
+void pager_prefetch(struct pager * pager, uint64_t number, size_t amount) {
+    uint64_t offset = number * PAGER_PAGE_SIZE;
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        uint64_t end = offset + amount * PAGER_PAGE_SIZE;
+        end = end < pager->mapping.length ? end : pager->mapping.length;
+
+        if (offset < end) {
+            posix_madvise(pager->mapping.base + offset, end - offset, POSIX_MADV_WILLNEED);
+        }
+
+        return;
+    }
+
+    // cached pages split the range into runs of consecutive pages of the file, logged pages are read from the log
+    uint64_t run = offset, length = 0;
+
+    for (uint64_t i = number; i < number + amount && i * PAGER_PAGE_SIZE < pager->size; ++i) {
+        uint64_t frame = pager_wal_get_frame(pager, i);
+        bool cached = pager_lookup(pager, i) != NULL;
+
+        if (!cached && frame == 0) {
+            length += PAGER_PAGE_SIZE;
+            continue;
+        }
+
+        if (!cached) {
+            pager_advise(pager->wal.fd, frame, PAGER_PAGE_SIZE);
+        }
+
+        pager_advise(pager->fd, run, length);
+        run = (i + 1) * PAGER_PAGE_SIZE;
+        length = 0;
+    }
+
+    pager_advise(pager->fd, run, length);
+}
+
+uint64_t pager_allocate(struct pager * pager, size_t amount) {
+    uint64_t offset = (pager->size + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE * PAGER_PAGE_SIZE;
+    pager->size = offset + amount * PAGER_PAGE_SIZE;
+
+    for (size_t i = 0; i < amount; ++i) {
+        struct pager_page * page = pager_pin(pager, offset / PAGER_PAGE_SIZE + i);
+        memset(page->data, 0, PAGER_PAGE_SIZE);
+        pager_unpin(pager, page, true);
+    }
+
+    return offset;
+}
+
+// Appends the dirty pages to the log as one transaction and syncs it according to the durability
+static void pager_commit(struct pager * pager, struct pager_page ** dirty, size_t amount) {
+    if (amount == 0 && !pager->wal.pending) {
+        return;
+    }
+
+    // frames of evicted pages are committed by the first page once again
+    struct pager_page * first = NULL;
+    if (amount == 0) {
+        first = pager_pin(pager, 0);
+        dirty = &first;
+        amount = 1;
+    }
+
+    pager_wal_append(pager, dirty, amount, true);
+
+    if (first) {
+        pager_unpin(pager, first, false);
+    }
+
+    if (pager->wal.durability == PAGER_DURABILITY_SYNC) {
+        fdatasync(pager->wal.fd);
+    }
+}
+
+static int pager_compare_pages(const void * a, const void * b) {
+    uint64_t first = (*(struct pager_page * const *) a)->number;
+    uint64_t second = (*(struct pager_page * const *) b)->number;
+
+    return first < second ? -1 : first > second;
+}
+
+void pager_flush(struct pager * pager) {
+    if (pager->mode == PAGER_MODE_MMAP) {
+        for (size_t i = 0; i < pager->frames.amount; ++i) {
+            pager->frames.pages[i].dirty = false;
+        }
+
+        return;
+    }
+
+    size_t amount = 0;
+    struct pager_page ** dirty = malloc(sizeof(*dirty) * pager->frames.amount);
+
+    for (size_t i = 0; i < pager->frames.amount; ++i) {
+        struct pager_page * page = &pager->frames.pages[i];
+
+        if (!page->used || !page->dirty) {
+            continue;
+        }
+
+        // pages past the end of the file are not written
+        page->dirty = false;
+        if (page->number * PAGER_PAGE_SIZE < pager->size) {
+            dirty[amount++] = page;
+        }
+    }
+
+    qsort(dirty, amount, sizeof(*dirty), pager_compare_pages);
+
+    if (pager->wal.fd >= 0) {
+        pager_commit(pager, dirty, amount);
+        free(dirty);
+
+        return;
+    }
+
+    // runs of consecutive pages are written with one system call
+    struct iovec vectors[PAGER_FLUSH_RUN];
+    for (size_t i = 0; i < amount;) {
+        uint64_t first = dirty[i]->number;
+        int count = 0;
+
+        while (i < amount && count < PAGER_FLUSH_RUN && dirty[i]->number == first + count) {
+            uint64_t offset = dirty[i]->number * PAGER_PAGE_SIZE;
+
+            vectors[count].iov_base = dirty[i]->data;
+            vectors[count].iov_len = pager->size - offset < PAGER_PAGE_SIZE ? pager->size - offset : PAGER_PAGE_SIZE;
+
+            ++count;
+            ++i;
+        }
+
+        pwritev(pager->fd, vectors, count, (off_t) (first * PAGER_PAGE_SIZE));
+    }
+
+    free(dirty);
+}
+
+void pager_checkpoint(struct pager * pager) {
+    pager_flush(pager);
+
+    if (pager->wal.fd >= 0) {
+        pager_wal_checkpoint(pager);
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Page cache structure:
+// - The file is split into pages of PAGER_PAGE_SIZE bytes
+// - A fixed amount of frames keeps the most recently used pages in memory
+// - Frames are evicted with the CLOCK algorithm, pinned frames are never evicted
+// - Dirty frames are written back on eviction and on pager_flush, the flush writes
+//   runs of consecutive pages with one vectored write
+//
+// In mmap mode the whole file is mapped into a reserved address range instead,
+// frames point directly into the mapping and nothing is copied or written back.
+// The mapping (and the file) grows by PAGER_MMAP_CHUNK bytes at once, the file
+// is truncated back to its real size on pager_delete.
+//
+// All reads and writes of the storage file must go through the pager. The pager uses
+// positional reads and writes only, so the file offset of the descriptor is never shared.
+// The pager is not locked, it (and the storage on top of it) is used by one thread at a time.
+//
+// pager_prefetch only hints the kernel to read pages which are not cached yet, so scans
+// keep many reads in flight while they process the pages they already have. Nothing is
+// loaded into frames until the page is pinned.
+//
+// Write-ahead log (cache mode only):
+// - Pages are never written to the storage file directly, each pager_flush commits
+//   all dirty pages as frames appended to the log, the last frame is marked as commit
+// - Evicted dirty pages are appended to the log too, the latest frame of every
+//   logged page is kept in memory and the page is read back from the log
+// - A checkpoint copies the latest frames to the storage file, syncs it and
+//   starts the log again, so the storage file only changes on checkpoints
+// - Commits never checkpoint, the caller checkpoints once the log is longer than
+//   PAGER_WAL_CHECKPOINT_FRAMES frames (the server does it after the response of the
+//   request), so the log to replay on start stays bounded
+// - On start committed frames left in the log are replayed by a checkpoint,
+//   frames after the last valid commit frame are ignored
+//
+// Log structure:
+// - Header: { signature: 0xfeedface, version: <uint32_t>, salt: <uint64_t> }
+// - Frames: { page number: <uint64_t>, size of the file for commit frames or 0: <uint64_t>,
+//   salt: <uint64_t>, checksum: <uint64_t>, page: <uint8_t[PAGER_PAGE_SIZE]> }[]
+// The checksum of a frame covers its header and page and continues the checksum of
+// the previous frame (the salt for the first one), the salt changes with every restart
+// of the log, so stale frames are never taken for valid ones.
+
+#define PAGER_PAGE_SIZE 4096
+#define PAGER_DEFAULT_CACHE_SIZE 1024
+#define PAGER_FLUSH_RUN 64
+#define PAGER_MMAP_CHUNK (16 * 1024 * 1024)
+#define PAGER_MMAP_RESERVE (1ULL << 40)
+#define PAGER_WAL_CHECKPOINT_FRAMES 4096
+
+enum pager_mode {
+    PAGER_MODE_CACHE = 0,
+    PAGER_MODE_MMAP = 1,
+};
+
+enum pager_durability {
+    // the log is synced on every commit
+    PAGER_DURABILITY_SYNC = 0,
+    // the log is synced only on checkpoints, every commit since the last one may be lost on a crash
+    PAGER_DURABILITY_ASYNC = 1,
+};
+
+struct pager_page {
+    uint64_t number;
+    unsigned int pins;
+    bool dirty;
+    bool referenced;
+    bool used;
+
+    long next;
+    uint8_t * data;
+};
+
+struct pager {
+    int fd;
+    enum pager_mode mode;
+    uint64_t size;
+
+    struct {
+        uint8_t * base;
+        uint64_t length;
+    } mapping;
+
+    struct {
+        size_t amount;
+        size_t hand;
+        struct pager_page * pages;
+    } frames;
+
+    struct {
+        size_t amount;
+        long * buckets;
+    } map;
+
+    struct {
+        int fd;
+        enum pager_durability durability;
+        uint64_t salt;
+        uint64_t checksum;
+        uint64_t size;
+        uint64_t frames;
+        // evicted pages are logged, but not committed yet
+        bool pending;
+
+        // offsets of the latest frames in the log by page numbers, 0 if the page is not logged
+        struct {
+            uint64_t amount;
+            uint64_t * frames;
+        } pages;
+
+        // frames and transactions replayed on start and milliseconds spent on it
+        struct {
+            uint64_t frames;
+            uint64_t transactions;
+            uint64_t time;
+        } recovery;
+    } wal;
+};
+
+struct pager * pager_new(int fd, int wal_fd, enum pager_mode mode, enum pager_durability durability, size_t cache_size);
+void pager_delete(struct pager * pager);
+
+struct pager_page * pager_pin(struct pager * pager, uint64_t number);
+void pager_unpin(struct pager * pager, struct pager_page * page, bool dirty);
+
+void pager_read(struct pager * pager, uint64_t offset, void * buf, size_t length);
+void pager_write(struct pager * pager, uint64_t offset, const void * buf, size_t length);
+void pager_prefetch(struct pager * pager, uint64_t number, size_t amount);
+uint64_t pager_allocate(struct pager * pager, size_t amount);
+
+void pager_flush(struct pager * pager);
+void pager_checkpoint(struct pager * pager);
@@ -14,6 +14,8 @@ void yyerror(struct json_object ** result, char ** error, const char * str);
 %token T_CREATE T_TABLE T_IDENTIFIER T_DBL_QUOTED T_INT T_UINT T_NUM T_STR T_DROP T_INSERT T_VALUES T_INTO
     T_INT_LITERAL T_UINT_LITERAL T_NUM_LITERAL T_STR_LITERAL T_NULL T_DELETE T_FROM T_WHERE T_JOIN T_ON
     T_EQ_OP T_NE_OP T_LT_OP T_GT_OP T_LE_OP T_GE_OP T_SELECT T_ASTERISK T_OFFSET T_LIMIT T_UPDATE T_SET
+    T_VACUUM T_INDEX T_USING T_BTREE T_HASH T_WITH T_FORMAT T_COLUMNAR T_ROWS
+    T_DICTIONARY T_SHOW T_STATS
 
 %left T_OR_OP
 %left T_AND_OP
@@ -37,18 +39,35 @@ command
     | delete_command        { $$ = $1; }
     | select_command        { $$ = $1; }
     | update_command        { $$ = $1; }
+    | vacuum_command        { $$ = $1; }
+    | create_index_command  { $$ = $1; }
+    | show_stats_command    { $$ = $1; }
     ;
 
 create_table_command
-    : T_CREATE t_table_non_req name '(' columns_declaration_list ')'    {
+    : T_CREATE t_table_non_req name '(' columns_declaration_list ')' table_format_non_req   {
         $$ = json_object_new_object();
 
         json_object_object_add($$, "action", json_object_new_int(0));
         json_object_object_add($$, "table", $3);
         json_object_object_add($$, "columns", $5);
+
+        if ($7) {
+            json_object_object_add($$, "format", $7);
+        }
     }
     ;
 
+table_format_non_req
+    : /* empty */                                   { $$ = NULL; }
+    | T_WITH '(' T_FORMAT T_EQ_OP table_format ')'  { $$ = $5; }
+    ;
+
+table_format
+    : T_ROWS        { $$ = json_object_new_int(STORAGE_TABLE_FORMAT_ROWS); }
+    | T_COLUMNAR    { $$ = json_object_new_int(STORAGE_TABLE_FORMAT_COLUMNS); }
+    ;
+
 t_table_non_req
     : /* empty */
     | T_TABLE
@@ -70,13 +89,22 @@ columns_declaration_list_req
     ;
 
 column_declaration
-    : name type     {
+    : name type t_dictionary_non_req    {
         $$ = json_object_new_object();
         json_object_object_add($$, "name", $1);
         json_object_object_add($$, "type", $2);
+
+        if ($3) {
+            json_object_object_add($$, "dictionary", $3);
+        }
     }
     ;
 
+t_dictionary_non_req
+    : /* empty */   { $$ = NULL; }
+    | T_DICTIONARY  { $$ = json_object_new_boolean(1); }
+    ;
+
 type
     : T_INT     { $$ = json_object_new_int(STORAGE_COLUMN_TYPE_INT); }
     | T_UINT    { $$ = json_object_new_int(STORAGE_COLUMN_TYPE_UINT); }
@@ -92,8 +120,45 @@ drop_table_command
     }
     ;
 
+create_index_command
+    : T_CREATE T_INDEX name T_ON name '(' name ')' index_type_non_req   {
+        $$ = json_object_new_object();
+
+        json_object_object_add($$, "action", json_object_new_int(7));
+        json_object_object_add($$, "index", $3);
+        json_object_object_add($$, "table", $5);
+        json_object_object_add($$, "column", $7);
+
+        if ($9) {
+            json_object_object_add($$, "type", $9);
+        }
+    }
+    ;
+
+index_type_non_req
+    : /* empty */       { $$ = NULL; }
+    | T_USING T_BTREE   { $$ = json_object_new_int(STORAGE_INDEX_TYPE_BTREE); }
+    | T_USING T_HASH    { $$ = json_object_new_int(STORAGE_INDEX_TYPE_HASH); }
+    ;
+
+show_stats_command
+    : T_SHOW T_STATS t_table_non_req name   {
+        $$ = json_object_new_object();
+        json_object_object_add($$, "action", json_object_new_int(8));
+        json_object_object_add($$, "table", $4);
+    }
+    ;
+
+vacuum_command
+    : T_VACUUM t_table_non_req name {
+        $$ = json_object_new_object();
+        json_object_object_add($$, "action", json_object_new_int(6));
+        json_object_object_add($$, "table", $3);
+    }
+    ;
+
 insert_command
-    : T_INSERT t_into_non_req name braced_names_list_non_req T_VALUES '(' values_list ')'   {
+    : T_INSERT t_into_non_req name braced_names_list_non_req T_VALUES rows_list_req {
         $$ = json_object_new_object();
 
         json_object_object_add($$, "action", json_object_new_int(2));
@@ -103,10 +168,19 @@ insert_command
             json_object_object_add($$, "columns", $4);
         }
 
-        json_object_object_add($$, "values", $7);
+        json_object_object_add($$, "rows", $6);
     }
     ;
 
+rows_list_req
+    : row                       { $$ = json_object_new_array(); json_object_array_add($$, $1); }
+    | rows_list_req ',' row     { $$ = $1; json_object_array_add($$, $3); }
+    ;
+
+row
+    : '(' values_list ')'   { $$ = $2 ? $2 : json_object_new_array(); }
+    ;
+
 t_into_non_req
     : /* empty */
     | T_INTO
@@ -7,13 +7,22 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <signal.h>
+#include <poll.h>
+#include <math.h>
 
 #include "storage.h"
 #include "json_api.h"
 
 static volatile bool closing = false;
 
+// interval of idle seconds between background vacuums, 0 disables them
+static int vacuum_interval = 0;
+
+// idle milliseconds after which the write-ahead log is checkpointed
+#define CHECKPOINT_IDLE_INTERVAL 1000
+
 static void close_handler(int sig, siginfo_t * info, void * context) {
     closing = true;
 }
@@ -24,26 +33,42 @@ static struct json_object * handle_request_create_table(struct json_api_create_t
     table->storage = storage;
     table->position = 0;
     table->next = 0;
-    table->first_row = 0;
+    table->first_page = 0;
+    table->last_page = 0;
+    table->free_page = 0;
+    table->first_index = 0;
+    table->indexes.amount = 0;
+    table->indexes.indexes = NULL;
     table->name = strdup(request.table_name);
+    table->format = request.format;
+    table->dictionaries = NULL;
+    table->stats.columns = NULL;
     table->columns.amount = request.columns.amount;
     table->columns.columns = malloc(sizeof(*table->columns.columns) * request.columns.amount);
 
     for (int i = 0; i < request.columns.amount; ++i) {
         table->columns.columns[i].name = strdup(request.columns.columns[i].name);
         table->columns.columns[i].type = request.columns.columns[i].type;
+        table->columns.columns[i].dictionary = request.columns.columns[i].dictionary;
     }
 
     errno = 0;
     storage_table_add(table);
-    bool error = errno != 0;
+    int error = errno;
+
+    if (error != 0) {
+        storage_table_delete(table);
+    }
 
-    storage_table_delete(table);
+    switch (error) {
+        case 0:
+            return json_api_make_success(json_object_new_object());
 
-    if (error) {
-        return json_api_make_error("a table with the same name is already exists");
-    } else {
-        return json_api_make_success(json_object_new_object());
+        case E2BIG:
+            return json_api_make_error("table has too many columns");
+
+        default:
+            return json_api_make_error("a table with the same name is already exists");
     }
 }
 
@@ -55,12 +80,90 @@ static struct json_object * handle_request_drop_table(struct json_api_drop_table
     }
 
     storage_table_remove(table);
-    storage_table_delete(table);
     return json_api_make_success(json_object_new_object());
 }
 
+static struct json_object * handle_request_vacuum(struct json_api_vacuum_request request, struct storage * storage) {
+    struct storage_table * table = storage_find_table(storage, request.table_name);
+
+    if (!table) {
+        return json_api_make_error("table with the specified name is not exists");
+    }
+
+    storage_table_vacuum(table);
+    return json_api_make_success(json_object_new_object());
+}
+
+static struct json_object * handle_request_create_index(struct json_api_create_index_request request, struct storage * storage) {
+    struct storage_table * table = storage_find_table(storage, request.table_name);
+
+    if (!table) {
+        return json_api_make_error("table with the specified name is not exists");
+    }
+
+    uint16_t column = 0;
+    while (column < table->columns.amount && strcmp(table->columns.columns[column].name, request.column) != 0) {
+        ++column;
+    }
+
+    if (column == table->columns.amount) {
+        size_t msg_length = 41 + strlen(request.column);
+
+        char msg[msg_length];
+        snprintf(msg, msg_length, "column with name %s is not exists in table", request.column);
+
+        return json_api_make_error(msg);
+    }
+
+    errno = 0;
+    if (!storage_table_add_index(table, request.index_name, column, request.type)) {
+        if (errno == E2BIG) {
+            return json_api_make_error("index name is too long");
+        }
+
+        return json_api_make_error("an index with the same name is already exists");
+    }
+
+    return json_api_make_success(json_object_new_object());
+}
+
+static struct json_object * handle_request_stats(struct json_api_stats_request request, struct storage * storage) {
+    struct storage_table * table = storage_find_table(storage, request.table_name);
+
+    if (!table) {
+        return json_api_make_error("table with the specified name is not exists");
+    }
+
+    struct json_object * columns = json_object_new_array();
+    json_object_array_add(columns, json_object_new_string("column"));
+    json_object_array_add(columns, json_object_new_string("nulls"));
+    json_object_array_add(columns, json_object_new_string("min"));
+    json_object_array_add(columns, json_object_new_string("max"));
+    json_object_array_add(columns, json_object_new_string("distinct"));
+
+    struct json_object * values = json_object_new_array();
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        struct storage_column_stats * stats = &table->stats.columns[i];
+        struct json_object * row = json_object_new_array();
+
+        json_object_array_add(row, json_object_new_string(table->columns.columns[i].name));
+        json_object_array_add(row, json_object_new_uint64(stats->nulls));
+        json_object_array_add(row, stats->bounded ? json_api_from_value(&stats->min) : NULL);
+        json_object_array_add(row, stats->bounded ? json_api_from_value(&stats->max) : NULL);
+        json_object_array_add(row, json_object_new_uint64(storage_column_stats_distinct(stats)));
+        json_object_array_add(values, row);
+    }
+
+    struct json_object * answer = json_object_new_object();
+    json_object_object_add(answer, "rows", json_object_new_uint64(table->stats.rows));
+    json_object_object_add(answer, "columns", columns);
+    json_object_object_add(answer, "values", values);
+
+    return json_api_make_success(answer);
+}
+
 static struct json_object * map_columns_to_indexes(unsigned int request_columns_amount, char ** request_columns_names,
-    struct storage_joined_table * table, unsigned int * columns_amount, unsigned int ** columns_indexes) {
+    struct storage_joined_table * table, unsigned int * columns_amount, unsigned int ** columns_indexes, struct arena * arena) {
     unsigned int columns_count = request_columns_amount;
 
     uint16_t table_columns_amount = storage_joined_table_get_columns_amount(table);
@@ -69,7 +172,7 @@ static struct json_object * map_columns_to_indexes(unsigned int request_columns_
         columns_count = table_columns_amount;
     }
 
-    *columns_indexes = malloc(sizeof(**columns_indexes) * columns_count);
+    *columns_indexes = arena_alloc(arena, sizeof(**columns_indexes) * columns_count);
     if (request_columns_amount == 0) {
         for (unsigned int i = 0; i < columns_count; ++i) {
             (*columns_indexes)[i] = i;
@@ -158,7 +261,7 @@ static struct json_object * check_values(unsigned int request_values_amount, str
     return NULL;
 }
 
-static struct json_object * handle_request_insert(struct json_api_insert_request request, struct storage * storage) {
+static struct json_object * handle_request_insert(struct json_api_insert_request request, struct storage * storage, struct arena * arena) {
     struct storage_table * table = storage_find_table(storage, request.table_name);
 
     if (!table) {
@@ -171,7 +274,7 @@ static struct json_object * handle_request_insert(struct json_api_insert_request
 
     {
         struct json_object * error = map_columns_to_indexes(request.columns.amount, request.columns.columns,
-            joined_table, &columns_amount, &columns_indexes);
+            joined_table, &columns_amount, &columns_indexes, arena);
 
         if (error) {
             storage_joined_table_delete(joined_table);
@@ -179,25 +282,43 @@ static struct json_object * handle_request_insert(struct json_api_insert_request
         }
     }
 
-    {
-        struct json_object * error = check_values(request.values.amount, request.values.values, table, columns_amount, columns_indexes);
+    struct storage_value ** values = arena_calloc(arena, table->columns.amount, sizeof(*values));
+
+    // all rows are checked before any of them is inserted, so a request inserts all its rows or none
+    for (unsigned int i = 0; i < request.rows.amount; ++i) {
+        struct json_object * error = check_values(request.rows.rows[i].amount, request.rows.rows[i].values,
+            table, columns_amount, columns_indexes);
 
         if (error) {
-            free(columns_indexes);
             storage_joined_table_delete(joined_table);
             return error;
         }
+
+        for (unsigned int j = 0; j < columns_amount; ++j) {
+            values[columns_indexes[j]] = request.rows.rows[i].values[j];
+        }
+
+        if (!storage_table_check_row(table, values)) {
+            storage_joined_table_delete(joined_table);
+            return json_api_make_error("string value is too long");
+        }
     }
 
-    struct storage_row * row = storage_table_add_row(table);
-    for (unsigned int i = 0; i < columns_amount; ++i) {
-        storage_row_set_value(row, columns_indexes[i], request.values.values[i]);
+    unsigned long long amount = 0;
+
+    for (; amount < request.rows.amount; ++amount) {
+        for (unsigned int i = 0; i < columns_amount; ++i) {
+            values[columns_indexes[i]] = request.rows.rows[amount].values[i];
+        }
+
+        storage_row_delete(storage_table_add_row(table, values));
     }
 
-    free(columns_indexes);
-    storage_row_delete(row);
     storage_joined_table_delete(joined_table);
-    return json_api_make_success(json_object_new_object());
+
+    struct json_object * answer = json_object_new_object();
+    json_object_object_add(answer, "amount", json_object_new_uint64(amount));
+    return json_api_make_success(answer);
 }
 
 static struct json_object * is_where_correct(struct storage_joined_table * table, struct json_api_where * where) {
@@ -484,98 +605,603 @@ static bool compare_values_not_null(enum json_api_operator op, struct storage_va
                     }
             }
 
+        // NaN is neither less, equal nor greater than any value, so it doesn't satisfy LE and GE too
         case JSON_API_OPERATOR_LE:
-            return !compare_values_not_null(JSON_API_OPERATOR_GT, left, right);
+            return compare_values_not_null(JSON_API_OPERATOR_LT, left, right) || compare_values_not_null(JSON_API_OPERATOR_EQ, left, right);
 
         case JSON_API_OPERATOR_GE:
-            return !compare_values_not_null(JSON_API_OPERATOR_LT, left, right);
+            return compare_values_not_null(JSON_API_OPERATOR_GT, left, right) || compare_values_not_null(JSON_API_OPERATOR_EQ, left, right);
 
         default:
             return false;
     }
 }
 
-static bool compare_values(enum json_api_operator op, struct storage_value * left, struct storage_value * right) {
-    switch (op) {
-        case JSON_API_OPERATOR_EQ:
-            if (left == NULL || right == NULL) {
-                return left == NULL && right == NULL;
+// Converts the value to the type of the column keeping the result of comparisons, returns false if it is not possible
+static bool convert_value(struct storage_value * value, enum storage_column_type type, struct storage_value * result) {
+    result->type = type;
+
+    switch (type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            switch (value->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                    result->value._int = value->value._int;
+                    return true;
+
+                case STORAGE_COLUMN_TYPE_UINT:
+                    result->value._int = (int64_t) value->value.uint;
+                    return value->value.uint <= INT64_MAX;
+
+                default:
+                    return false;
             }
 
-            break;
+        case STORAGE_COLUMN_TYPE_UINT:
+            switch (value->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                    result->value.uint = (uint64_t) value->value._int;
+                    return value->value._int >= 0;
 
-        case JSON_API_OPERATOR_NE:
-            if (left == NULL || right == NULL) {
-                return (left == NULL) != (right == NULL);
+                case STORAGE_COLUMN_TYPE_UINT:
+                    result->value.uint = value->value.uint;
+                    return true;
+
+                default:
+                    return false;
             }
 
-            break;
+        case STORAGE_COLUMN_TYPE_NUM:
+            // integers are compared with doubles after the same conversion
+            switch (value->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                    result->value.num = (double) value->value._int;
+                    return true;
+
+                case STORAGE_COLUMN_TYPE_UINT:
+                    result->value.num = (double) value->value.uint;
+                    return true;
+
+                case STORAGE_COLUMN_TYPE_NUM:
+                    result->value.num = value->value.num;
+                    return true;
+
+                default:
+                    return false;
+            }
+
+        case STORAGE_COLUMN_TYPE_STR:
+            result->value.str = value->value.str;
+            return value->type == STORAGE_COLUMN_TYPE_STR;
+    }
+
+    return false;
+}
+
+// Compiled where expression:
+// - Every condition is resolved once per request to the index of its column, its value converted to
+//   the type the column is compared in and the outcomes of the comparison which satisfy its operator
+// - AND and OR become jumps, a condition continues with one of two next conditions or finishes
+//   with the result, so a row is checked by a plain loop over the conditions
+// - Equality of a dictionary column compares codes, the code of the value is looked up once
+
+#define WHERE_TRUE UINT_MAX
+#define WHERE_FALSE (UINT_MAX - 1)
+
+// outcomes of the comparison of a column value with the value of the condition
+#define WHERE_LESS 0x1
+#define WHERE_EQUAL 0x2
+#define WHERE_GREATER 0x4
+#define WHERE_UNORDERED 0x8
+
+#define WHERE_COMPARE(left, right) ((left) < (right) ? WHERE_LESS : (left) > (right) ? WHERE_GREATER \
+    : (left) == (right) ? WHERE_EQUAL : WHERE_UNORDERED)
+
+enum where_domain {
+    WHERE_DOMAIN_INT = 0,
+    WHERE_DOMAIN_UINT = 1,
+    WHERE_DOMAIN_NUM = 2,
+    WHERE_DOMAIN_STR = 3,
+    // codes of a dictionary column
+    WHERE_DOMAIN_CODE = 4,
+    // every value of the column has the same outcome
+    WHERE_DOMAIN_ANY = 5,
+};
+
+struct where_condition {
+    enum where_domain domain;
+    uint16_t column;
+    // outcomes which satisfy the operator
+    uint8_t outcomes;
+    // result for NULL values of the column
+    bool null_result;
+
+    union {
+        int64_t _int;
+        uint64_t uint;
+        double num;
+        const char * str;
+        struct {
+            // false if the value is not in the dictionary, so it is equal to no value of the column
+            bool found;
+            uint64_t code;
+        } code;
+        uint8_t outcome;
+    } value;
+
+    // next conditions by the result, or WHERE_TRUE/WHERE_FALSE
+    unsigned int on_true;
+    unsigned int on_false;
+};
+
+struct where_program {
+    unsigned int amount;
+    struct where_condition * conditions;
+};
+
+static uint8_t get_operator_outcomes(enum json_api_operator op) {
+    switch (op) {
+        case JSON_API_OPERATOR_EQ:
+            return WHERE_EQUAL;
+
+        case JSON_API_OPERATOR_NE:
+            return WHERE_LESS | WHERE_GREATER | WHERE_UNORDERED;
 
         case JSON_API_OPERATOR_LT:
+            return WHERE_LESS;
+
         case JSON_API_OPERATOR_GT:
+            return WHERE_GREATER;
+
+        // unordered values (NaN) satisfy only NE, so a scan finds the same rows as a range of an index
         case JSON_API_OPERATOR_LE:
+            return WHERE_LESS | WHERE_EQUAL;
+
         case JSON_API_OPERATOR_GE:
-            if (left == NULL || right == NULL) {
-                return false;
-            }
+            return WHERE_GREATER | WHERE_EQUAL;
+
+        default:
+            return 0;
+    }
+}
+
+static unsigned int count_conditions(struct json_api_where * where) {
+    if (where->op == JSON_API_OPERATOR_AND || where->op == JSON_API_OPERATOR_OR) {
+        return count_conditions(where->left) + count_conditions(where->right);
+    }
+
+    return 1;
+}
+
+// The condition must be checked by is_where_correct
+static void compile_condition(struct storage_joined_table * table, struct json_api_where * where, struct where_condition * condition) {
+    uint16_t table_columns_amount = storage_joined_table_get_columns_amount(table);
+
+    condition->column = 0;
+    while (condition->column < table_columns_amount
+        && strcmp(storage_joined_table_get_column(table, condition->column).name, where->column) != 0) {
+        ++condition->column;
+    }
+
+    struct storage_column column = storage_joined_table_get_column(table, condition->column);
+    condition->outcomes = get_operator_outcomes(where->op);
+    condition->null_result = where->op == JSON_API_OPERATOR_NE;
+
+    // only EQ and NE compare with NULL, NULL is equal to NULL only
+    if (where->value == NULL) {
+        condition->domain = WHERE_DOMAIN_ANY;
+        condition->value.outcome = WHERE_UNORDERED;
+        condition->null_result = where->op == JSON_API_OPERATOR_EQ;
+        return;
+    }
+
+    if (column.dictionary && (where->op == JSON_API_OPERATOR_EQ || where->op == JSON_API_OPERATOR_NE)) {
+        condition->domain = WHERE_DOMAIN_CODE;
+        condition->value.code.found = storage_joined_table_find_code(table, condition->column, where->value->value.str,
+            &condition->value.code.code);
+        return;
+    }
+
+    struct storage_value value;
+    if (convert_value(where->value, column.type, &value)) {
+        switch (column.type) {
+            case STORAGE_COLUMN_TYPE_INT:
+                condition->domain = WHERE_DOMAIN_INT;
+                condition->value._int = value.value._int;
+                return;
+
+            case STORAGE_COLUMN_TYPE_UINT:
+                condition->domain = WHERE_DOMAIN_UINT;
+                condition->value.uint = value.value.uint;
+                return;
+
+            case STORAGE_COLUMN_TYPE_NUM:
+                condition->domain = WHERE_DOMAIN_NUM;
+                condition->value.num = value.value.num;
+                return;
+
+            case STORAGE_COLUMN_TYPE_STR:
+                condition->domain = WHERE_DOMAIN_STR;
+                condition->value.str = value.value.str;
+                return;
+        }
+    }
+
+    // integers of the column are compared with a double as doubles
+    if (where->value->type == STORAGE_COLUMN_TYPE_NUM) {
+        condition->domain = WHERE_DOMAIN_NUM;
+        condition->value.num = where->value->value.num;
+        return;
+    }
+
+    // an integer out of the range of the column type is greater or less than all its values
+    condition->domain = WHERE_DOMAIN_ANY;
+    condition->value.outcome = where->value->type == STORAGE_COLUMN_TYPE_UINT ? WHERE_LESS : WHERE_GREATER;
+}
+
+// Compiles the expression to conditions from the specified one, which jump to on_true or on_false
+// with the result of the whole expression
+static void compile_conditions(struct storage_joined_table * table, struct json_api_where * where,
+    struct where_condition * conditions, unsigned int index, unsigned int on_true, unsigned int on_false) {
+
+    switch (where->op) {
+        case JSON_API_OPERATOR_AND:
+        {
+            unsigned int right = index + count_conditions(where->left);
+
+            compile_conditions(table, where->left, conditions, index, right, on_false);
+            compile_conditions(table, where->right, conditions, right, on_true, on_false);
+            break;
+        }
 
+        case JSON_API_OPERATOR_OR:
+        {
+            unsigned int right = index + count_conditions(where->left);
+
+            compile_conditions(table, where->left, conditions, index, on_true, right);
+            compile_conditions(table, where->right, conditions, right, on_true, on_false);
             break;
+        }
 
         default:
-            return false;
+            compile_condition(table, where, &conditions[index]);
+            conditions[index].on_true = on_true;
+            conditions[index].on_false = on_false;
+            break;
+    }
+}
+
+// Compiles the checked where expression for the joined table, returns NULL without the expression
+static struct where_program * compile_where(struct storage_joined_table * table, struct json_api_where * where, struct arena * arena) {
+    if (!where) {
+        return NULL;
+    }
+
+    struct where_program * program = arena_alloc(arena, sizeof(*program));
+    program->amount = count_conditions(where);
+    program->conditions = arena_alloc(arena, sizeof(*program->conditions) * program->amount);
+
+    compile_conditions(table, where, program->conditions, 0, WHERE_TRUE, WHERE_FALSE);
+    return program;
+}
+
+// Values of the current row read on demand and shared by the where expression and the projection:
+// - Every column is read at most once per row, columns nobody asks for are never read
+// - Strings are read into the arena, the caller rewinds it before the next row
+struct row_values {
+    struct storage_joined_row * row;
+    struct arena * arena;
+
+    // number of the current row, a column is read for the current row if it has the same number
+    uint64_t number;
+    uint64_t * numbers;
+    bool * found;
+    struct storage_value * values;
+};
+
+static void row_values_init(struct row_values * values, struct storage_joined_table * table, struct arena * arena) {
+    uint16_t amount = storage_joined_table_get_columns_amount(table);
+
+    values->row = NULL;
+    values->arena = arena;
+    values->number = 0;
+    values->numbers = arena_calloc(arena, amount, sizeof(*values->numbers));
+    values->found = arena_alloc(arena, sizeof(*values->found) * amount);
+    values->values = arena_alloc(arena, sizeof(*values->values) * amount);
+}
+
+// Moves to the next row, values read for the previous one are dropped
+static void row_values_set_row(struct row_values * values, struct storage_joined_row * row) {
+    values->row = row;
+    ++values->number;
+}
+
+// Returns the value of the column of the current row or NULL if it is NULL
+static struct storage_value * row_values_get(struct row_values * values, uint16_t column) {
+    if (values->numbers[column] != values->number) {
+        values->numbers[column] = values->number;
+        values->found[column] = storage_joined_row_read_value_in_arena(values->row, column, &values->values[column], values->arena);
+    }
+
+    return values->found[column] ? &values->values[column] : NULL;
+}
+
+static bool test_condition(struct row_values * values, const struct where_condition * condition) {
+    uint8_t outcome;
+
+    if (condition->domain == WHERE_DOMAIN_CODE) {
+        uint64_t code;
+
+        if (!storage_joined_row_get_code(values->row, condition->column, &code)) {
+            return condition->null_result;
+        }
+
+        outcome = condition->value.code.found && code == condition->value.code.code ? WHERE_EQUAL : WHERE_UNORDERED;
+        return (condition->outcomes & outcome) != 0;
+    }
+
+    const struct storage_value * value = row_values_get(values, condition->column);
+    if (!value) {
+        return condition->null_result;
+    }
+
+    switch (condition->domain) {
+        case WHERE_DOMAIN_INT:
+            outcome = WHERE_COMPARE(value->value._int, condition->value._int);
+            break;
+
+        case WHERE_DOMAIN_UINT:
+            outcome = WHERE_COMPARE(value->value.uint, condition->value.uint);
+            break;
+
+        case WHERE_DOMAIN_NUM:
+        {
+            double num = value->type == STORAGE_COLUMN_TYPE_NUM ? value->value.num
+                : value->type == STORAGE_COLUMN_TYPE_INT ? (double) value->value._int : (double) value->value.uint;
+
+            outcome = WHERE_COMPARE(num, condition->value.num);
+            break;
+        }
+
+        case WHERE_DOMAIN_STR:
+        {
+            int cmp = strcmp(value->value.str, condition->value.str);
+
+            outcome = WHERE_COMPARE(cmp, 0);
+            break;
+        }
+
+        default:
+            outcome = condition->value.outcome;
+            break;
     }
 
-    return compare_values_not_null(op, *left, *right);
+    return (condition->outcomes & outcome) != 0;
 }
 
-static bool eval_where(struct storage_joined_row * row, struct json_api_where * where) {
-    uint16_t table_columns_amount = storage_joined_table_get_columns_amount(row->table);
+static bool eval_where(struct row_values * values, const struct where_program * program) {
+    unsigned int index = 0;
 
+    while (index < program->amount) {
+        const struct where_condition * condition = &program->conditions[index];
+        index = test_condition(values, condition) ? condition->on_true : condition->on_false;
+    }
+
+    return index == WHERE_TRUE;
+}
+
+// Finds the column of the first table of the joined table which the condition bounds, returns false if there is no such column
+static bool get_condition_column(struct storage_joined_table * table, struct json_api_where * where, uint16_t * column) {
     switch (where->op) {
         case JSON_API_OPERATOR_EQ:
-        case JSON_API_OPERATOR_NE:
         case JSON_API_OPERATOR_LT:
         case JSON_API_OPERATOR_GT:
         case JSON_API_OPERATOR_LE:
         case JSON_API_OPERATOR_GE:
-            for (unsigned int i = 0; i < table_columns_amount; ++i) {
-                if (strcmp(storage_joined_table_get_column(row->table, i).name, where->column) == 0) {
-                    return compare_values(where->op, storage_joined_row_get_value(row, i), where->value);
-                }
-            }
+            break;
 
-            errno = EINVAL;
+        default:
             return false;
+    }
 
-        case JSON_API_OPERATOR_AND:
-            return eval_where(row, where->left) && eval_where(row, where->right);
+    struct storage_table * first = table->tables.tables[0].table;
+    uint16_t table_columns_amount = storage_joined_table_get_columns_amount(table);
+    struct storage_value value;
 
-        case JSON_API_OPERATOR_OR:
-            return eval_where(row, where->left) || eval_where(row, where->right);
+    for (uint16_t i = 0; i < table_columns_amount; ++i) {
+        if (strcmp(storage_joined_table_get_column(table, i).name, where->column) == 0) {
+            if (i >= first->columns.amount || where->value == NULL || !convert_value(where->value, first->columns.columns[i].type, &value)) {
+                return false;
+            }
+
+            // no value is in a range bounded by NaN, the condition is left to the where
+            if (value.type == STORAGE_COLUMN_TYPE_NUM && isnan(value.value.num)) {
+                return false;
+            }
+
+            *column = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns the index of the first table of the joined table usable by the condition or NULL
+static struct storage_index * get_condition_index(struct storage_joined_table * table, struct json_api_where * where, uint16_t * column) {
+    if (!get_condition_column(table, where, column)) {
+        return NULL;
+    }
+
+    struct storage_table * first = table->tables.tables[0].table;
+
+    // a hash index finds only equal values
+    struct storage_index * index = NULL;
+    if (where->op == JSON_API_OPERATOR_EQ) {
+        index = storage_table_get_index(first, *column, STORAGE_INDEX_TYPE_HASH);
+    }
+
+    return index ? index : storage_table_get_index(first, *column, STORAGE_INDEX_TYPE_BTREE);
+}
+
+// Looks for a condition joined with AND to the others which can use an index, equality is preferred
+static struct json_api_where * find_indexed_condition(struct storage_joined_table * table, struct json_api_where * where, bool equality) {
+    if (where->op == JSON_API_OPERATOR_AND) {
+        struct json_api_where * left = find_indexed_condition(table, where->left, equality);
+        return left ? left : find_indexed_condition(table, where->right, equality);
+    }
+
+    uint16_t column;
+    if ((where->op == JSON_API_OPERATOR_EQ) != equality || get_condition_index(table, where, &column) == NULL) {
+        return NULL;
+    }
+
+    return where;
+}
+
+// Narrows the range of the column by all conditions joined with AND
+static void narrow_range(struct storage_joined_table * table, struct json_api_where * where, uint16_t column,
+    struct storage_value ** from, struct storage_value ** to, struct storage_value * from_value, struct storage_value * to_value) {
+
+    if (where->op == JSON_API_OPERATOR_AND) {
+        narrow_range(table, where->left, column, from, to, from_value, to_value);
+        narrow_range(table, where->right, column, from, to, from_value, to_value);
+        return;
+    }
+
+    uint16_t condition_column;
+    if (!get_condition_column(table, where, &condition_column) || condition_column != column) {
+        return;
+    }
+
+    struct storage_value value;
+    convert_value(where->value, table->tables.tables[0].table->columns.columns[column].type, &value);
+
+    // strict comparisons are checked again with the whole condition
+    if (where->op == JSON_API_OPERATOR_EQ || where->op == JSON_API_OPERATOR_GT || where->op == JSON_API_OPERATOR_GE) {
+        if (*from == NULL || compare_values_not_null(JSON_API_OPERATOR_GT, value, **from)) {
+            *from_value = value;
+            *from = from_value;
+        }
+    }
+
+    if (where->op == JSON_API_OPERATOR_EQ || where->op == JSON_API_OPERATOR_LT || where->op == JSON_API_OPERATOR_LE) {
+        if (*to == NULL || compare_values_not_null(JSON_API_OPERATOR_LT, value, **to)) {
+            *to_value = value;
+            *to = to_value;
+        }
+    }
+}
+
+// Restricts rows of the first table to the rows found by an index, if the where has a suitable condition
+static void use_index(struct storage_joined_table * table, struct json_api_where * where) {
+    struct json_api_where * condition = find_indexed_condition(table, where, true);
+
+    if (!condition) {
+        condition = find_indexed_condition(table, where, false);
+    }
+
+    if (!condition) {
+        return;
+    }
+
+    uint16_t column;
+    struct storage_index * index = get_condition_index(table, condition, &column);
+
+    struct storage_value * from = NULL, * to = NULL;
+    struct storage_value from_value, to_value;
+
+    if (index->type == STORAGE_INDEX_TYPE_HASH) {
+        convert_value(condition->value, table->tables.tables[0].table->columns.columns[column].type, &from_value);
+        from = to = &from_value;
+    } else {
+        narrow_range(table, where, column, &from, &to, &from_value, &to_value);
+    }
+
+    size_t amount;
+    uint64_t * positions = storage_index_find(index, from, to, &amount);
+
+    if (positions) {
+        storage_joined_table_set_positions(table, positions, amount);
+    }
+}
+
+// Passes ranges of numeric columns of the first table narrowed by the where to the scan, so it skips
+// segments of a columnar table by their zone maps
+static void use_zone_maps(struct storage_joined_table * table, struct json_api_where * where) {
+    struct storage_table * first = table->tables.tables[0].table;
+
+    if (first->format != STORAGE_TABLE_FORMAT_COLUMNS || table->rows.positions) {
+        return;
+    }
+
+    size_t amount = 0;
+    struct storage_range * ranges = malloc(sizeof(*ranges) * first->columns.amount);
+
+    for (uint16_t i = 0; i < first->columns.amount; ++i) {
+        if (first->columns.columns[i].type == STORAGE_COLUMN_TYPE_STR) {
+            continue;
+        }
+
+        struct storage_value * from = NULL, * to = NULL;
+        struct storage_value from_value, to_value;
+        narrow_range(table, where, i, &from, &to, &from_value, &to_value);
+
+        if (from || to) {
+            ranges[amount].column = i;
+            ranges[amount].has_from = from != NULL;
+            ranges[amount].has_to = to != NULL;
+            ranges[amount].from = from_value;
+            ranges[amount].to = to_value;
+            ++amount;
+        }
     }
+
+    if (amount == 0) {
+        free(ranges);
+        return;
+    }
+
+    storage_joined_table_set_ranges(table, ranges, amount);
 }
 
-static struct json_object * handle_request_delete(struct json_api_delete_request request, struct storage * storage) {
+static struct json_object * handle_request_delete(struct json_api_delete_request request, struct storage * storage, struct arena * arena) {
     struct storage_table * table = storage_find_table(storage, request.table_name);
 
     if (!table) {
         return json_api_make_error("table with the specified name is not exists");
     }
 
-    struct storage_joined_table * joined_table = storage_joined_table_wrap(table);
+    unsigned long long amount = 0;
+    if (request.where == NULL) {
+        // without a condition all data pages are freed at once
+        amount = storage_table_truncate(table);
 
-    if (request.where) {
-        struct json_object * error = is_where_correct(joined_table, request.where);
+        struct json_object * answer = json_object_new_object();
+        json_object_object_add(answer, "amount", json_object_new_uint64(amount));
+        return json_api_make_success(answer);
+    }
 
-        if (error) {
-            storage_joined_table_delete(joined_table);
-            return error;
-        }
+    struct storage_joined_table * joined_table = storage_joined_table_wrap(table);
+    struct json_object * error = is_where_correct(joined_table, request.where);
+
+    if (error) {
+        storage_joined_table_delete(joined_table);
+        return error;
     }
 
-    unsigned long long amount = 0;
+    use_index(joined_table, request.where);
+    use_zone_maps(joined_table, request.where);
+
+    struct where_program * where = compile_where(joined_table, request.where, arena);
+    struct row_values values;
+    row_values_init(&values, joined_table, arena);
+    struct arena_mark mark = arena_mark(arena);
+
     for (struct storage_joined_row * row = storage_joined_table_get_first_row(joined_table); row; row = storage_joined_row_next(row)) {
-        if (request.where == NULL || eval_where(row, request.where)) {
+        arena_rewind(arena, mark);
+        row_values_set_row(&values, row);
+
+        if (eval_where(&values, where)) {
             storage_row_remove(row->rows[0]);
             ++amount;
         }
@@ -587,7 +1213,7 @@ static struct json_object * handle_request_delete(struct json_api_delete_request
     return json_api_make_success(answer);
 }
 
-static struct json_object * handle_request_select(struct json_api_select_request request, struct storage * storage) {
+static struct json_object * handle_request_select(struct json_api_select_request request, struct storage * storage, struct arena * arena) {
     if (request.limit > 1000) {
         return json_api_make_error("limit is too high");
     }
@@ -653,6 +1279,9 @@ static struct json_object * handle_request_select(struct json_api_select_request
             storage_joined_table_delete(joined_table);
             return error;
         }
+
+        use_index(joined_table, request.where);
+        use_zone_maps(joined_table, request.where);
     }
 
     unsigned int columns_amount;
@@ -660,7 +1289,7 @@ static struct json_object * handle_request_select(struct json_api_select_request
 
     {
         struct json_object * error = map_columns_to_indexes(request.columns.amount, request.columns.columns,
-            joined_table, &columns_amount, &columns_indexes);
+            joined_table, &columns_amount, &columns_indexes, arena);
 
         if (error) {
             storage_joined_table_delete(joined_table);
@@ -682,22 +1311,32 @@ static struct json_object * handle_request_select(struct json_api_select_request
     {
         struct json_object * values = json_object_new_array_ext((int) request.limit);
 
+        // projected columns are read only for rows which are returned, columns of the where are read once for both
+        struct where_program * where = compile_where(joined_table, request.where, arena);
+        struct row_values row_values;
+        row_values_init(&row_values, joined_table, arena);
+        struct arena_mark mark = arena_mark(arena);
+
         unsigned int offset = 0, amount = 0;
         for (struct storage_joined_row * row = storage_joined_table_get_first_row(joined_table); row; row = storage_joined_row_next(row)) {
-            if (request.where == NULL || eval_where(row, request.where)) {
+            arena_rewind(arena, mark);
+            row_values_set_row(&row_values, row);
+
+            if (where == NULL || eval_where(&row_values, where)) {
                 if (offset < request.offset) {
                     ++offset;
                     continue;
                 }
 
                 if (amount == request.limit) {
+                    storage_joined_row_delete(row);
                     break;
                 }
 
                 struct json_object * values_row = json_object_new_array_ext((int) columns_amount);
 
                 for (unsigned int i = 0; i < columns_amount; ++i) {
-                    json_object_array_add(values_row, json_api_from_value(storage_joined_row_get_value(row, columns_indexes[i])));
+                    json_object_array_add(values_row, json_api_from_value(row_values_get(&row_values, columns_indexes[i])));
                 }
 
                 json_object_array_add(values, values_row);
@@ -708,12 +1347,18 @@ static struct json_object * handle_request_select(struct json_api_select_request
         json_object_object_add(answer, "values", values);
     }
 
-    free(columns_indexes);
+    // the rows are not returned partially
+    if (joined_table->error != 0) {
+        json_object_put(answer);
+        storage_joined_table_delete(joined_table);
+        return json_api_make_error("cannot join tables, temporary files of the join are not available");
+    }
+
     storage_joined_table_delete(joined_table);
     return json_api_make_success(answer);
 }
 
-static struct json_object * handle_request_update(struct json_api_update_request request, struct storage * storage) {
+static struct json_object * handle_request_update(struct json_api_update_request request, struct storage * storage, struct arena * arena) {
     struct storage_table * table = storage_find_table(storage, request.table_name);
 
     if (!table) {
@@ -729,6 +1374,9 @@ static struct json_object * handle_request_update(struct json_api_update_request
             storage_joined_table_delete(joined_table);
             return error;
         }
+
+        use_index(joined_table, request.where);
+        use_zone_maps(joined_table, request.where);
     }
 
     unsigned int columns_amount;
@@ -736,7 +1384,7 @@ static struct json_object * handle_request_update(struct json_api_update_request
 
     {
         struct json_object * error = map_columns_to_indexes(request.columns.amount, request.columns.columns,
-            joined_table, &columns_amount, &columns_indexes);
+            joined_table, &columns_amount, &columns_indexes, arena);
 
         if (error) {
             storage_joined_table_delete(joined_table);
@@ -748,63 +1396,117 @@ static struct json_object * handle_request_update(struct json_api_update_request
         struct json_object * error = check_values(request.values.amount, request.values.values, table, columns_amount, columns_indexes);
 
         if (error) {
-            free(columns_indexes);
             storage_joined_table_delete(joined_table);
             return error;
         }
     }
 
+    struct where_program * where = compile_where(joined_table, request.where, arena);
+    struct row_values values;
+    row_values_init(&values, joined_table, arena);
+    struct arena_mark mark = arena_mark(arena);
+
     unsigned long long amount = 0;
     for (struct storage_joined_row * row = storage_joined_table_get_first_row(joined_table); row; row = storage_joined_row_next(row)) {
-        if (request.where == NULL || eval_where(row, request.where)) {
-            for (unsigned int i = 0; i < columns_amount; ++i) {
-                storage_row_set_value(row->rows[0], columns_indexes[i], request.values.values[i]);
-            }
+        arena_rewind(arena, mark);
+        row_values_set_row(&values, row);
 
+        if (where == NULL || eval_where(&values, where)) {
+            storage_row_set_values(row->rows[0], columns_amount, columns_indexes, request.values.values);
             ++amount;
         }
     }
 
-    free(columns_indexes);
     storage_joined_table_delete(joined_table);
     struct json_object * answer = json_object_new_object();
     json_object_object_add(answer, "amount", json_object_new_uint64(amount));
     return json_api_make_success(answer);
 }
 
-static struct json_object * handle_request(struct json_object * request, struct storage * storage) {
+static struct json_object * handle_request(struct json_object * request, struct storage * storage, struct arena * arena) {
     enum json_api_action action = json_api_get_action(request);
 
     switch (action) {
         case JSON_API_TYPE_CREATE_TABLE:
-            return handle_request_create_table(json_api_to_create_table_request(request), storage);
+            return handle_request_create_table(json_api_to_create_table_request(request, arena), storage);
 
         case JSON_API_TYPE_DROP_TABLE:
-            return handle_request_drop_table(json_api_to_drop_table_request(request), storage);
+            return handle_request_drop_table(json_api_to_drop_table_request(request, arena), storage);
 
         case JSON_API_TYPE_INSERT:
-            return handle_request_insert(json_api_to_insert_request(request), storage);
+            return handle_request_insert(json_api_to_insert_request(request, arena), storage, arena);
 
         case JSON_API_TYPE_DELETE:
-            return handle_request_delete(json_api_to_delete_request(request), storage);
+            return handle_request_delete(json_api_to_delete_request(request, arena), storage, arena);
 
         case JSON_API_TYPE_SELECT:
-            return handle_request_select(json_api_to_select_request(request), storage);
+            return handle_request_select(json_api_to_select_request(request, arena), storage, arena);
 
         case JSON_API_TYPE_UPDATE:
-            return handle_request_update(json_api_to_update_request(request), storage);
+            return handle_request_update(json_api_to_update_request(request, arena), storage, arena);
+
+        case JSON_API_TYPE_VACUUM:
+            return handle_request_vacuum(json_api_to_vacuum_request(request, arena), storage);
+
+        case JSON_API_TYPE_CREATE_INDEX:
+            return handle_request_create_index(json_api_to_create_index_request(request, arena), storage);
+
+        case JSON_API_TYPE_STATS:
+            return handle_request_stats(json_api_to_stats_request(request, arena), storage);
 
         default:
             return NULL;
     }
 }
 
+// Waits until the socket is readable, checkpoints the log and vacuums fragmented tables while it stays idle
+static bool wait_socket(int socket, struct storage * storage) {
+    struct pollfd fd = { .fd = socket, .events = POLLIN };
+
+    while (!closing) {
+        struct pager * pager = storage->pager;
+        int timeout = vacuum_interval > 0 ? vacuum_interval * 1000 : -1;
+
+        // the log is checkpointed before the vacuum
+        if (pager->wal.frames > 0) {
+            timeout = CHECKPOINT_IDLE_INTERVAL;
+        }
+
+        int ret = poll(&fd, 1, timeout);
+
+        if (ret > 0) {
+            return true;
+        }
+
+        if (ret < 0 && errno != EINTR) {
+            return false;
+        }
+
+        if (ret == 0 && pager->wal.frames > 0) {
+            storage_checkpoint(storage);
+        } else if (ret == 0) {
+            storage_vacuum(storage);
+            storage_flush(storage);
+        }
+    }
+
+    return false;
+}
+
 static void handle_client(int socket, struct storage * storage) {
     printf("Connected\n");
 
+    // everything parsed and read for a request lives until its response is written
+    struct arena arena;
+    arena_init(&arena);
+
     while (!closing) {
         char buffer[64 * 1024];
 
+        if (!wait_socket(socket, storage)) {
+            break;
+        }
+
         ssize_t was_read = read(socket, buffer, sizeof(buffer) / sizeof(*buffer));
         if (was_read <= 0) {
             break;
@@ -822,7 +1524,8 @@ static void handle_client(int socket, struct storage * storage) {
         struct json_object * response_object = NULL;
 
         if (request) {
-            response_object = handle_request(request, storage);
+            response_object = handle_request(request, storage, &arena);
+            storage_flush(storage);
         }
 
         const char * response = json_object_to_json_string(response_object);
@@ -839,18 +1542,78 @@ static void handle_client(int socket, struct storage * storage) {
             response_length -= wrote;
             response += wrote;
         }
+
+        json_object_put(request);
+        json_object_put(response_object);
+        arena_reset(&arena);
+
+        // the log is bounded by a checkpoint after the response, so the request doesn't wait for it
+        if (storage->pager->wal.frames >= PAGER_WAL_CHECKPOINT_FRAMES) {
+            storage_checkpoint(storage);
+        }
     }
 
+    arena_destroy(&arena);
     close(socket);
     printf("Disconnected\n");
 }
 
 int main(int argc, char * argv[]) {
-    if (argc < 2) {
+    enum pager_mode mode = PAGER_MODE_CACHE;
+    enum pager_durability durability = PAGER_DURABILITY_SYNC;
+    bool durability_set = false;
+    size_t cache_size = PAGER_DEFAULT_CACHE_SIZE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:mv:")) != -1) {
+        switch (opt) {
+            case 'c':
+                // size of the page cache in pages
+                cache_size = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'd':
+                // when commits are synced to disk: sync - every one before its response (default), async - on checkpoints
+                if (strcmp(optarg, "sync") == 0) {
+                    durability = PAGER_DURABILITY_SYNC;
+                } else if (strcmp(optarg, "async") == 0) {
+                    durability = PAGER_DURABILITY_ASYNC;
+                } else {
+                    fprintf(stderr, "Unknown durability %s, expected sync or async\n", optarg);
+                    return 0;
+                }
+
+                durability_set = true;
+                break;
+
+            case 'm':
+                // map the storage file instead of caching its pages
+                mode = PAGER_MODE_MMAP;
+                break;
+
+            case 'v':
+                // vacuum fragmented tables after the specified amount of idle seconds
+                vacuum_interval = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-c cache_pages] [-d sync|async] [-m] [-v vacuum_seconds] file\n", argv[0]);
+                return 0;
+        }
+    }
+
+    if (optind >= argc) {
         return 0;
     }
 
-    int fd = open(argv[1], O_RDWR);
+    // pages of the mapping are written back by the system without the log, so nothing is synced on commits
+    if (mode == PAGER_MODE_MMAP && durability_set) {
+        fprintf(stderr, "Durability can't be set in mmap mode, commits are not logged\n");
+        return 0;
+    }
+
+    const char * filename = argv[optind];
+    int fd = open(filename, O_RDWR);
     struct storage * storage;
 
     if (fd < 0 && errno != ENOENT) {
@@ -858,13 +1621,40 @@ int main(int argc, char * argv[]) {
         return errno;
     }
 
-    if (fd < 0 && errno == ENOENT) {
-        fd = open(argv[1], O_CREAT | O_RDWR, 0644);
-        storage = storage_init(fd);
+    // the write-ahead log is kept next to the file, a log of a removed file is dropped
+    size_t wal_filename_length = strlen(filename) + 5;
+    char wal_filename[wal_filename_length];
+    snprintf(wal_filename, wal_filename_length, "%s-wal", filename);
+
+    int wal_fd = open(wal_filename, O_CREAT | O_RDWR | (fd < 0 ? O_TRUNC : 0), 0644);
+    if (wal_fd < 0) {
+        perror("Error while opening write-ahead log");
+        return errno;
+    }
+
+    if (fd < 0) {
+        fd = open(filename, O_CREAT | O_RDWR, 0644);
+        storage = fd >= 0 ? storage_init(fd, wal_fd, mode, durability, cache_size) : NULL;
     } else {
-        storage = storage_open(fd);
+        storage = storage_open(fd, wal_fd, mode, durability, cache_size);
+    }
+
+    // the file may be of another format or not a storage at all
+    if (!storage) {
+        int error = errno != 0 ? errno : EINVAL;
+        fprintf(stderr, "Error while opening storage: %s\n", strerror(error));
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        close(wal_fd);
+        return error;
     }
 
+    printf("Recovered %lu frames of %lu transactions in %lu ms\n", storage->pager->wal.recovery.frames,
+        storage->pager->wal.recovery.transactions, storage->pager->wal.recovery.time);
+
     // create the server socket
     int server_socket;
     server_socket = socket(AF_INET, SOCK_STREAM, 0);
@@ -896,6 +1686,10 @@ int main(int argc, char * argv[]) {
     }
 
     while (!closing) {
+        if (!wait_socket(server_socket, storage)) {
+            break;
+        }
+
         int ret = accept(server_socket, NULL, NULL);
 
         if (ret < 0) {
@@ -908,6 +1702,7 @@ int main(int argc, char * argv[]) {
     close(server_socket);
     storage_delete(storage);
     close(fd);
+    close(wal_fd);
 
     printf("Bye!\n");
     return 0;
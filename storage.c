@@ -1,567 +1,4269 @@
-#define _LARGEFILE64_SOURCE
-
 #include "storage.h"
 
-#include <unistd.h>
 #include <errno.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 #define SIGNATURE ("\xDE\xAD\xBA\xBE")
+#define VERSION 10
+
+#define STORAGE_HEADER_FIRST_TABLE 8
+#define STORAGE_HEADER_PAGES 16
+#define STORAGE_HEADER_FREE_SPACE_MAP 24
+#define STORAGE_TABLE_HEADER_FIRST_PAGE 8
+#define STORAGE_TABLE_HEADER_FIRST_INDEX 32
+#define STORAGE_STATS_COLUMN_LENGTH (4 * sizeof(uint64_t) + STORAGE_STATS_SKETCH_SIZE)
+#define STORAGE_INDEX_HEADER_ROOT 8
+#define STORAGE_INDEX_HEADER_DEPTH 19
+
+#define STORAGE_FREE_SPACE_MAP_BITS ((PAGER_PAGE_SIZE - sizeof(uint64_t)) * 8)
+#define STORAGE_FREE_PAGE_THRESHOLD (PAGER_PAGE_SIZE / 4)
+#define STORAGE_PAGE_IN_FREE_LIST 1
+
+#define STORAGE_ROW_PAGE(position) ((position) / PAGER_PAGE_SIZE * PAGER_PAGE_SIZE)
+#define STORAGE_ROW_SLOT(position) ((uint16_t) ((position) % PAGER_PAGE_SIZE))
+
+#define STORAGE_ALIGN(length) (((length) + 7) / 8 * 8)
+
+#define STORAGE_CATALOG_INITIAL_SIZE 16
+
+#define STORAGE_INDEX_STRING_KEY_LENGTH 24
+#define STORAGE_INDEX_MAX_DEPTH 32
+
+#define STORAGE_HASH_BUCKET_CAPACITY ((PAGER_PAGE_SIZE - sizeof(struct storage_hash_bucket)) / sizeof(struct storage_hash_entry))
+#define STORAGE_HASH_MAX_DEPTH 20
+
+#define STORAGE_DICTIONARY_INITIAL_SIZE 16
+#define STORAGE_DICTIONARY_INLINE (PAGER_PAGE_SIZE - sizeof(struct storage_strings_header) - sizeof(uint16_t))
+#define STORAGE_COLUMN_DICTIONARY 1
+
+#define STORAGE_SEGMENT_ROWS (PAGER_PAGE_SIZE / sizeof(uint64_t))
+#define STORAGE_SEGMENT_BITMAP (STORAGE_SEGMENT_ROWS / 8)
+#define STORAGE_SEGMENT_ZONE (2 * sizeof(uint64_t))
+#define STORAGE_SEGMENT_MAX_COLUMNS ((PAGER_PAGE_SIZE - sizeof(struct storage_segment_header) - STORAGE_SEGMENT_BITMAP) \
+    / (STORAGE_SEGMENT_BITMAP + STORAGE_SEGMENT_ZONE))
+
+struct storage_page_header {
+    uint64_t next;
+    uint64_t prev;
+    uint64_t next_free;
+    uint64_t prev_free;
+    uint16_t slots;
+    uint16_t heap;
+    uint16_t dead;
+    uint16_t flags;
+};
+
+struct storage_slot {
+    uint16_t offset;
+    uint16_t length;
+};
+
+struct storage_segment_header {
+    uint64_t next;
+    uint64_t prev;
+    uint64_t strings;
+    uint16_t rows;
+    uint16_t live;
+    uint32_t reserved;
+};
+
+struct storage_strings_header {
+    uint64_t next;
+    uint16_t used;
+    uint16_t reserved[3];
+};
+
+struct storage_string_cell {
+    uint16_t offset;
+    uint16_t length;
+    uint32_t blob;
+};
+
+struct storage_index_node {
+    uint64_t next;
+    uint16_t leaf;
+    uint16_t amount;
+    uint32_t reserved;
+};
+
+struct storage_hash_bucket {
+    uint64_t next;
+    uint16_t depth;
+    uint16_t amount;
+    uint32_t reserved;
+};
+
+struct storage_hash_entry {
+    uint64_t hash;
+    uint64_t position;
+};
+
+static void storage_load_free_space_map(struct storage * storage) {
+    storage->free_space_map.amount = 0;
+    storage->free_space_map.pages = NULL;
+    storage->free_space_map.free = 0;
+    storage->free_space_map.hint = UINT64_MAX;
+
+    uint64_t pointer;
+    pager_read(storage->pager, STORAGE_HEADER_FREE_SPACE_MAP, &pointer, sizeof(pointer));
+
+    while (pointer) {
+        storage->free_space_map.pages = realloc(storage->free_space_map.pages,
+            sizeof(*storage->free_space_map.pages) * (storage->free_space_map.amount + 1));
+        storage->free_space_map.pages[storage->free_space_map.amount] = pointer;
+
+        struct pager_page * page = pager_pin(storage->pager, pointer / PAGER_PAGE_SIZE);
+        const uint8_t * bits = page->data + sizeof(uint64_t);
+
+        for (size_t i = 0; i < STORAGE_FREE_SPACE_MAP_BITS / 8; ++i) {
+            if (bits[i] == 0) {
+                continue;
+            }
+
+            storage->free_space_map.free += __builtin_popcount(bits[i]);
+            if (storage->free_space_map.hint == UINT64_MAX) {
+                storage->free_space_map.hint = storage->free_space_map.amount * STORAGE_FREE_SPACE_MAP_BITS + i * 8;
+            }
+        }
+
+        memcpy(&pointer, page->data, sizeof(pointer));
+        pager_unpin(storage->pager, page, false);
+        ++storage->free_space_map.amount;
+    }
+
+    if (storage->free_space_map.hint == UINT64_MAX) {
+        storage->free_space_map.hint = 0;
+    }
+}
+
+static uint64_t storage_hash_bytes(const void * data, size_t length) {
+    // FNV-1a with the final mix of murmur3, low bits are used as bucket numbers
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ ((const uint8_t *) data)[i]) * 1099511628211ULL;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static size_t storage_catalog_hash(const char * name) {
+    return (size_t) storage_hash_bytes(name, strlen(name));
+}
+
+static void storage_catalog_init(struct storage * storage) {
+    storage->tables.amount = 0;
+    storage->tables.size = STORAGE_CATALOG_INITIAL_SIZE;
+    storage->tables.buckets = calloc(storage->tables.size, sizeof(*storage->tables.buckets));
+}
+
+static void storage_catalog_insert(struct storage * storage, struct storage_table * table) {
+    if (storage->tables.amount >= storage->tables.size) {
+        size_t size = storage->tables.size * 2;
+        struct storage_table ** buckets = calloc(size, sizeof(*buckets));
+
+        for (size_t i = 0; i < storage->tables.size; ++i) {
+            for (struct storage_table * entry = storage->tables.buckets[i]; entry;) {
+                struct storage_table * next = entry->next_in_bucket;
+                size_t bucket = storage_catalog_hash(entry->name) % size;
+
+                entry->next_in_bucket = buckets[bucket];
+                buckets[bucket] = entry;
+                entry = next;
+            }
+        }
 
-#ifdef PLATFORM_MACOS
-#include <sys/dtrace.h>
-#define lseek64(handle,offset,whence) lseek(handle,offset,whence) // macos
-#endif
+        free(storage->tables.buckets);
+        storage->tables.size = size;
+        storage->tables.buckets = buckets;
+    }
+
+    size_t bucket = storage_catalog_hash(table->name) % storage->tables.size;
+    table->next_in_bucket = storage->tables.buckets[bucket];
+    storage->tables.buckets[bucket] = table;
+    ++storage->tables.amount;
+}
+
+static void storage_catalog_remove(struct storage * storage, struct storage_table * table) {
+    struct storage_table ** link = &storage->tables.buckets[storage_catalog_hash(table->name) % storage->tables.size];
+
+    while (*link != table) {
+        link = &(*link)->next_in_bucket;
+    }
+
+    *link = table->next_in_bucket;
+    table->next_in_bucket = NULL;
+    --storage->tables.amount;
+}
 
-struct storage * storage_init(int fd) {
-    lseek64(fd, 0, SEEK_SET);
+static struct storage_table * storage_table_load(struct storage * storage, uint64_t pointer);
+static void storage_stats_write(struct storage_table * table);
+static void storage_join_hash_delete(struct storage_join_hash * hash);
 
-    write(fd, SIGNATURE, 4);
+static void storage_load_catalog(struct storage * storage) {
+    storage_catalog_init(storage);
 
-    uint64_t p = 0;
-    write(fd, &p, sizeof(p));
+    for (uint64_t pointer = storage->first_table; pointer;) {
+        struct storage_table * table = storage_table_load(storage, pointer);
 
+        storage_catalog_insert(storage, table);
+        pointer = table->next;
+    }
+}
+
+struct storage * storage_init(int fd, int wal_fd, enum pager_mode mode, enum pager_durability durability, size_t cache_size) {
     struct storage * storage = malloc(sizeof(*storage));
 
     storage->fd = fd;
+    storage->pager = pager_new(fd, wal_fd, mode, durability, cache_size);
     storage->first_table = 0;
+    storage->free_space_map.amount = 0;
+    storage->free_space_map.pages = NULL;
+    storage->free_space_map.free = 0;
+    storage->free_space_map.hint = 0;
+
+    uint32_t version = VERSION;
+    uint64_t pages = 1;
+    uint64_t free_space_map = 0;
+    pager_write(storage->pager, 0, SIGNATURE, 4);
+    pager_write(storage->pager, 4, &version, sizeof(version));
+    pager_write(storage->pager, STORAGE_HEADER_FIRST_TABLE, &storage->first_table, sizeof(storage->first_table));
+    pager_write(storage->pager, STORAGE_HEADER_PAGES, &pages, sizeof(pages));
+    pager_write(storage->pager, STORAGE_HEADER_FREE_SPACE_MAP, &free_space_map, sizeof(free_space_map));
+
+    storage_catalog_init(storage);
+
+    // an empty storage is committed at once, so it is found after a crash
+    pager_flush(storage->pager);
     return storage;
 }
 
-struct storage * storage_open(int fd) {
-    lseek64(fd, 0, SEEK_SET);
+struct storage * storage_open(int fd, int wal_fd, enum pager_mode mode, enum pager_durability durability, size_t cache_size) {
+    struct pager * pager = pager_new(fd, wal_fd, mode, durability, cache_size);
 
     char sign[4];
-    if (read(fd, sign, 4) != 4) {
+    uint32_t version;
+    if (pager->size < STORAGE_HEADER_FREE_SPACE_MAP + sizeof(uint64_t)) {
+        pager_delete(pager);
         errno = EINVAL;
         return NULL;
     }
 
-    if (memcmp(sign, SIGNATURE, 4) != 0) {
+    pager_read(pager, 0, sign, 4);
+    pager_read(pager, 4, &version, sizeof(version));
+    if (memcmp(sign, SIGNATURE, 4) != 0 || version != VERSION) {
+        pager_delete(pager);
         errno = EINVAL;
         return NULL;
     }
 
     struct storage * storage = malloc(sizeof(*storage));
     storage->fd = fd;
+    storage->pager = pager;
+
+    pager_read(pager, STORAGE_HEADER_FIRST_TABLE, &storage->first_table, sizeof(storage->first_table));
 
-    read(fd, &storage->first_table, sizeof(storage->first_table));
+    // the file may be longer than the storage if it was preallocated
+    uint64_t pages;
+    pager_read(pager, STORAGE_HEADER_PAGES, &pages, sizeof(pages));
+    if (pages * PAGER_PAGE_SIZE < pager->size) {
+        pager->size = pages * PAGER_PAGE_SIZE;
+    }
+
+    storage_load_free_space_map(storage);
+    storage_load_catalog(storage);
     return storage;
 }
 
 void storage_delete(struct storage * storage) {
-    free(storage);
-}
+    if (storage) {
+        pager_delete(storage->pager);
+        free(storage->free_space_map.pages);
 
-static char * storage_read_string(int fd) {
-    uint16_t length;
+        for (size_t i = 0; i < storage->tables.size; ++i) {
+            for (struct storage_table * table = storage->tables.buckets[i]; table;) {
+                struct storage_table * next = table->next_in_bucket;
 
-    read(fd, &length, sizeof(length));
+                storage_table_delete(table);
+                table = next;
+            }
+        }
 
-    char * str = malloc(sizeof(int8_t) * (length + 1));
-    read(fd, str, length);
-    str[length] = '\0';
+        free(storage->tables.buckets);
+    }
 
-    return str;
+    free(storage);
 }
 
-struct storage_table * storage_find_table(struct storage * storage, const char * name) {
-    uint64_t pointer = storage->first_table;
-
-    while (pointer) {
-        lseek64(storage->fd, (off64_t) pointer, SEEK_SET);
+void storage_flush(struct storage * storage) {
+    // stats are kept in memory and written once per transaction
+    for (size_t i = 0; i < storage->tables.size; ++i) {
+        for (struct storage_table * table = storage->tables.buckets[i]; table; table = table->next_in_bucket) {
+            if (table->stats.dirty) {
+                storage_stats_write(table);
+            }
+        }
+    }
 
-        uint64_t next, first_row;
-        read(storage->fd, &next, sizeof(next));
-        read(storage->fd, &first_row, sizeof(first_row));
+    pager_flush(storage->pager);
+}
 
-        char * table_name = storage_read_string(storage->fd);
-        if (strcmp(table_name, name) != 0) {
-            free(table_name);
-            pointer = next;
-            continue;
-        }
+void storage_checkpoint(struct storage * storage) {
+    pager_checkpoint(storage->pager);
+}
 
-        struct storage_table * table = malloc(sizeof(*table));
-        table->storage = storage;
-        table->position = pointer;
-        table->next = next;
-        table->first_row = first_row;
-        table->name = table_name;
+static void storage_read(struct storage * storage, uint64_t * offset, void * buf, size_t length) {
+    pager_read(storage->pager, *offset, buf, length);
+    *offset += length;
+}
 
-        read(storage->fd, &table->columns.amount, sizeof(table->columns.amount));
-        table->columns.columns = malloc(sizeof(*table->columns.columns) * table->columns.amount);
+static char * storage_read_string(struct storage * storage, uint64_t * offset) {
+    uint16_t length;
 
-        for (uint16_t i = 0; i < table->columns.amount; ++i) {
-            table->columns.columns[i].name = storage_read_string(storage->fd);
+    storage_read(storage, offset, &length, sizeof(length));
 
-            uint8_t type;
-            read(storage->fd, &type, sizeof(type));
-            table->columns.columns[i].type = (enum storage_column_type) type;
-        }
+    char * str = malloc(sizeof(int8_t) * (length + 1));
+    storage_read(storage, offset, str, length);
+    str[length] = '\0';
 
-        return table;
-    }
+    return str;
+}
 
-    return NULL;
+static void storage_write_at(struct storage * storage, uint64_t offset, const void * buf, size_t length) {
+    pager_write(storage->pager, offset, buf, length);
 }
 
-void storage_table_delete(struct storage_table * table) {
-    if (table) {
-        free(table->name);
+static void storage_put(uint8_t * data, size_t * offset, const void * buf, size_t length) {
+    memcpy(data + *offset, buf, length);
+    *offset += length;
+}
 
-        for (uint16_t i = 0; i < table->columns.amount; ++i) {
-            free(table->columns.columns[i].name);
-        }
+static void storage_put_string(uint8_t * data, size_t * offset, const char * str) {
+    uint16_t length = strlen(str);
 
-        free(table->columns.columns);
-    }
+    storage_put(data, offset, &length, sizeof(length));
+    storage_put(data, offset, str, length);
+}
 
-    free(table);
+static struct pager_page * storage_pin(struct storage * storage, uint64_t pointer) {
+    return pager_pin(storage->pager, pointer / PAGER_PAGE_SIZE);
 }
 
-static uint64_t storage_write(int fd, void * buf, size_t length) {
-    uint64_t offset = lseek64(fd, 0, SEEK_END);
+static struct storage_page_header * storage_page_header(struct pager_page * page) {
+    return (struct storage_page_header *) page->data;
+}
 
-    write(fd, buf, length);
-    return offset;
+static struct storage_slot * storage_page_slots(struct pager_page * page) {
+    return (struct storage_slot *) (page->data + sizeof(struct storage_page_header));
 }
 
-static uint64_t storage_write_string(int fd, const char * str) {
-    uint16_t length = strlen(str);
+static uint64_t storage_extend(struct storage * storage, size_t amount) {
+    uint64_t pointer = pager_allocate(storage->pager, amount);
 
-    uint64_t ret = storage_write(fd, &length, sizeof(length));
-    write(fd, str, length);
-    return ret;
+    uint64_t pages = storage->pager->size / PAGER_PAGE_SIZE;
+    storage_write_at(storage, STORAGE_HEADER_PAGES, &pages, sizeof(pages));
+    return pointer;
 }
 
-void storage_table_add(struct storage_table * table) {
-    struct storage_table * another_table = storage_find_table(table->storage, table->name);
-
-    if (another_table != NULL) {
-        storage_table_delete(another_table);
-        errno = EINVAL;
-        return;
-    }
+// Marks pages as free or used in the free space map, returns false if the map doesn't cover them
+static bool storage_free_space_map_set(struct storage * storage, uint64_t number, size_t amount, bool free) {
+    while (amount > 0) {
+        size_t index = number / STORAGE_FREE_SPACE_MAP_BITS;
+        if (index >= storage->free_space_map.amount) {
+            return false;
+        }
 
-    table->next = table->storage->first_table;
-    table->position = storage_write(table->storage->fd, &table->next, sizeof(table->next));
-    table->storage->first_table = table->position;
+        struct pager_page * page = pager_pin(storage->pager, storage->free_space_map.pages[index] / PAGER_PAGE_SIZE);
+        uint8_t * bits = page->data + sizeof(uint64_t);
 
-    write(table->storage->fd, &table->first_row, sizeof(table->first_row));
-    storage_write_string(table->storage->fd, table->name);
-    write(table->storage->fd, &table->columns.amount, sizeof(table->columns.amount));
+        for (; amount > 0 && number / STORAGE_FREE_SPACE_MAP_BITS == index; ++number, --amount) {
+            size_t bit = number % STORAGE_FREE_SPACE_MAP_BITS;
 
-    for (uint16_t i = 0; i < table->columns.amount; ++i) {
-        storage_write_string(table->storage->fd, table->columns.columns[i].name);
+            if (free) {
+                bits[bit / 8] |= (uint8_t) (1 << (bit % 8));
+            } else {
+                bits[bit / 8] &= (uint8_t) ~(1 << (bit % 8));
+            }
+        }
 
-        uint8_t type = table->columns.columns[i].type;
-        write(table->storage->fd, &type, sizeof(type));
+        pager_unpin(storage->pager, page, true);
     }
 
-    lseek64(table->storage->fd, 4, SEEK_SET);
-    write(table->storage->fd, &table->position, sizeof(table->position));
+    return true;
 }
 
-void storage_table_remove(struct storage_table * table) {
-    uint64_t pointer = table->storage->first_table;
+// Looks for the first run of free pages of the specified length, returns 0 if there is no such run
+static uint64_t storage_free_space_map_find(struct storage * storage, size_t amount) {
+    uint64_t number = storage->free_space_map.hint;
+    uint64_t run_start = 0;
+    size_t run = 0;
+    bool hint_found = false;
+
+    for (size_t index = number / STORAGE_FREE_SPACE_MAP_BITS; index < storage->free_space_map.amount; ++index) {
+        struct pager_page * page = pager_pin(storage->pager, storage->free_space_map.pages[index] / PAGER_PAGE_SIZE);
+        const uint8_t * bits = page->data + sizeof(uint64_t);
+
+        // runs don't cross pages of the map
+        run = 0;
+        for (size_t bit = number % STORAGE_FREE_SPACE_MAP_BITS; bit < STORAGE_FREE_SPACE_MAP_BITS; ++bit, ++number) {
+            if (bit % 8 == 0 && bits[bit / 8] == 0) {
+                run = 0;
+                bit += 7;
+                number += 7;
+                continue;
+            }
 
-    while (pointer) {
-        lseek64(table->storage->fd, (off64_t) pointer, SEEK_SET);
+            if (((bits[bit / 8] >> (bit % 8)) & 1) == 0) {
+                run = 0;
+                continue;
+            }
 
-        uint64_t next;
-        read(table->storage->fd, &next, sizeof(next));
+            if (!hint_found) {
+                storage->free_space_map.hint = number;
+                hint_found = true;
+            }
 
-        if (next == table->position) {
-            break;
+            if (run++ == 0) {
+                run_start = number;
+            }
+
+            if (run == amount) {
+                pager_unpin(storage->pager, page, false);
+                return run_start;
+            }
         }
 
-        pointer = next;
+        pager_unpin(storage->pager, page, false);
     }
 
-    if (pointer == 0) {
-        pointer = 4;
-        table->storage->first_table = table->next;
+    if (!hint_found) {
+        storage->free_space_map.hint = number;
     }
 
-    lseek64(table->storage->fd, (off64_t) pointer, SEEK_SET);
-    write(table->storage->fd, &table->next, sizeof(table->next));
+    return 0;
 }
 
-struct storage_row * storage_table_get_first_row(struct storage_table * table) {
-    if (table->first_row == 0) {
-        return NULL;
-    }
+static uint64_t storage_allocate(struct storage * storage, size_t amount) {
+    if (storage->free_space_map.free >= amount) {
+        uint64_t number = storage_free_space_map_find(storage, amount);
 
-    struct storage_row * row = malloc(sizeof(*row));
-    row->position = table->first_row;
-    row->table = table;
+        if (number != 0) {
+            storage_free_space_map_set(storage, number, amount, false);
+            storage->free_space_map.free -= amount;
 
-    lseek64(table->storage->fd, (off64_t) row->position, SEEK_SET);
-    read(table->storage->fd, &row->next, sizeof(row->next));
+            for (size_t i = 0; i < amount; ++i) {
+                struct pager_page * page = pager_pin(storage->pager, number + i);
+                memset(page->data, 0, PAGER_PAGE_SIZE);
+                pager_unpin(storage->pager, page, true);
+            }
 
-    return row;
+            return number * PAGER_PAGE_SIZE;
+        }
+    }
+
+    return storage_extend(storage, amount);
 }
 
-struct storage_row * storage_table_add_row(struct storage_table * table) {
-    struct storage_row * row = malloc(sizeof(*row));
+static void storage_free(struct storage * storage, uint64_t pointer, size_t amount) {
+    uint64_t number = pointer / PAGER_PAGE_SIZE;
 
-    row->table = table;
-    row->next = table->first_row;
-    row->position = storage_write(table->storage->fd, &row->next, sizeof(row->next));
-    table->first_row = row->position;
+    while (!storage_free_space_map_set(storage, number, amount, true)) {
+        uint64_t map = storage_extend(storage, 1);
 
-    uint64_t null = 0;
-    for (uint16_t i = 0; i < table->columns.amount; ++i) {
-        write(table->storage->fd, &null, sizeof(null));
+        if (storage->free_space_map.amount == 0) {
+            storage_write_at(storage, STORAGE_HEADER_FREE_SPACE_MAP, &map, sizeof(map));
+        } else {
+            storage_write_at(storage, storage->free_space_map.pages[storage->free_space_map.amount - 1], &map, sizeof(map));
+        }
+
+        storage->free_space_map.pages = realloc(storage->free_space_map.pages,
+            sizeof(*storage->free_space_map.pages) * (storage->free_space_map.amount + 1));
+        storage->free_space_map.pages[storage->free_space_map.amount++] = map;
     }
 
-    lseek64(table->storage->fd, (off64_t) (table->position + sizeof(uint64_t)), SEEK_SET);
-    write(table->storage->fd, &table->first_row, sizeof(table->first_row));
-    return row;
+    storage->free_space_map.free += amount;
+    if (number < storage->free_space_map.hint) {
+        storage->free_space_map.hint = number;
+    }
 }
 
-void storage_row_delete(struct storage_row * row) {
-    free(row);
+static size_t storage_blob_pages(uint16_t length) {
+    return length > 0 ? (length + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE : 1;
 }
 
-struct storage_row * storage_row_next(struct storage_row * row) {
-    row->position = row->next;
+static uint64_t storage_allocate_data_page(struct storage * storage) {
+    uint64_t pointer = storage_allocate(storage, 1);
+
+    struct pager_page * page = storage_pin(storage, pointer);
+    struct storage_page_header * header = storage_page_header(page);
+    header->next = 0;
+    header->prev = 0;
+    header->next_free = 0;
+    header->prev_free = 0;
+    header->slots = 0;
+    header->heap = PAGER_PAGE_SIZE;
+    header->dead = 0;
+    header->flags = 0;
+    pager_unpin(storage->pager, page, true);
+
+    return pointer;
+}
 
-    if (row->next == 0) {
-        free(row);
-        return NULL;
+static size_t storage_page_free_space(struct storage_page_header * header) {
+    return header->heap - sizeof(*header) - header->slots * sizeof(struct storage_slot);
+}
+
+static void storage_page_compact(struct pager_page * page) {
+    struct storage_page_header * header = storage_page_header(page);
+    struct storage_slot * slots = storage_page_slots(page);
+
+    uint8_t buffer[PAGER_PAGE_SIZE];
+    memcpy(buffer, page->data, PAGER_PAGE_SIZE);
+
+    uint16_t heap = PAGER_PAGE_SIZE;
+    for (uint16_t i = 0; i < header->slots; ++i) {
+        if (slots[i].offset == 0) {
+            continue;
+        }
+
+        heap -= slots[i].length;
+        memcpy(page->data + heap, buffer + slots[i].offset, slots[i].length);
+        slots[i].offset = heap;
     }
 
-    lseek64(row->table->storage->fd, (off64_t) row->position, SEEK_SET);
-    read(row->table->storage->fd, &row->next, sizeof(row->next));
-    return row;
+    header->heap = heap;
+    header->dead = 0;
 }
 
-void storage_row_remove(struct storage_row * row) {
-    uint64_t pointer = row->table->first_row;
-
-    while (pointer) {
-        lseek64(row->table->storage->fd, (off64_t) pointer, SEEK_SET);
+// Places a record of the specified length into the page, returns its slot or -1 if the page is full
+static int storage_page_insert(struct pager_page * page, uint16_t length) {
+    struct storage_page_header * header = storage_page_header(page);
+    struct storage_slot * slots = storage_page_slots(page);
 
-        uint64_t next;
-        read(row->table->storage->fd, &next, sizeof(next));
+    uint16_t slot = 0;
+    while (slot < header->slots && slots[slot].offset != 0) {
+        ++slot;
+    }
 
-        if (next == row->position) {
-            break;
+    size_t needed = length + (slot == header->slots ? sizeof(struct storage_slot) : 0);
+    if (storage_page_free_space(header) < needed) {
+        if (storage_page_free_space(header) + header->dead < needed) {
+            return -1;
         }
 
-        pointer = next;
+        storage_page_compact(page);
     }
 
-    if (pointer == 0) {
-        pointer = row->table->position + sizeof(uint64_t);
-        row->table->first_row = row->next;
+    if (slot == header->slots) {
+        ++header->slots;
     }
 
-    lseek64(row->table->storage->fd, (off64_t) pointer, SEEK_SET);
-    write(row->table->storage->fd, &row->next, sizeof(row->next));
+    header->heap -= length;
+    slots[slot].offset = header->heap;
+    slots[slot].length = length;
+    return slot;
 }
 
-struct storage_value * storage_row_get_value(struct storage_row * row, uint16_t index) {
-    if (index >= row->table->columns.amount) {
-        errno = EINVAL;
-        return NULL;
-    }
-
-    lseek64(row->table->storage->fd, (off64_t) (row->position + (1 + index) * sizeof(uint64_t)), SEEK_SET);
+static void storage_page_remove(struct pager_page * page, uint16_t slot) {
+    struct storage_page_header * header = storage_page_header(page);
+    struct storage_slot * slots = storage_page_slots(page);
 
-    uint64_t pointer;
-    read(row->table->storage->fd, &pointer, sizeof(pointer));
+    header->dead += slots[slot].length;
+    slots[slot].offset = 0;
+    slots[slot].length = 0;
 
-    if (pointer == 0) {
-        return NULL;
+    while (header->slots > 0 && slots[header->slots - 1].offset == 0) {
+        --header->slots;
     }
+}
 
-    lseek64(row->table->storage->fd, (off64_t) pointer, SEEK_SET);
+// Moves the record to a place of the new length inside of its page, returns false if the page is full
+static bool storage_page_resize(struct pager_page * page, uint16_t slot, uint16_t length) {
+    struct storage_page_header * header = storage_page_header(page);
+    struct storage_slot * slots = storage_page_slots(page);
 
-    struct storage_value * value = malloc(sizeof(*value));
-    value->type = row->table->columns.columns[index].type;
+    if (length <= slots[slot].length) {
+        return true;
+    }
 
-    switch (value->type) {
-        case STORAGE_COLUMN_TYPE_INT:
-            read(row->table->storage->fd, &value->value._int, sizeof(value->value._int));
-            break;
+    if (storage_page_free_space(header) + header->dead + slots[slot].length < length) {
+        return false;
+    }
 
-        case STORAGE_COLUMN_TYPE_UINT:
-            read(row->table->storage->fd, &value->value.uint, sizeof(value->value.uint));
-            break;
+    uint8_t record[PAGER_PAGE_SIZE];
+    uint16_t old_length = slots[slot].length;
+    memcpy(record, page->data + slots[slot].offset, old_length);
 
-        case STORAGE_COLUMN_TYPE_NUM:
-            read(row->table->storage->fd, &value->value.num, sizeof(value->value.num));
-            break;
+    header->dead += old_length;
+    slots[slot].offset = 0;
 
-        case STORAGE_COLUMN_TYPE_STR:
-            value->value.str = storage_read_string(row->table->storage->fd);
-            break;
+    if (storage_page_free_space(header) < length) {
+        storage_page_compact(page);
     }
 
-    return value;
+    header->heap -= length;
+    slots[slot].offset = header->heap;
+    slots[slot].length = length;
+    memcpy(page->data + slots[slot].offset, record, old_length);
+    return true;
 }
 
-void storage_row_set_value(struct storage_row * row, uint16_t index, struct storage_value * value) {
-    if (index >= row->table->columns.amount) {
-        errno = EINVAL;
-        return;
+static void storage_dictionary_map_insert(struct storage_dictionary * dictionary, uint32_t code) {
+    const char * str = dictionary->codes.strings[code];
+    size_t mask = dictionary->map.size - 1;
+    size_t slot = storage_hash_bytes(str, strlen(str)) & mask;
+
+    while (dictionary->map.slots[slot] != 0) {
+        slot = (slot + 1) & mask;
     }
 
-    uint64_t pointer = 0;
+    dictionary->map.slots[slot] = code + 1;
+}
 
-    if (value) {
-        if (row->table->columns.columns[index].type != value->type) {
-            errno = EINVAL;
-            return;
+// Adds the string to the dictionary in memory, the dictionary takes its ownership
+static void storage_dictionary_add(struct storage_dictionary * dictionary, char * str) {
+    // the map is kept at most half full, the strings array has a half of its size
+    if ((dictionary->codes.amount + 1) * 2 > dictionary->map.size) {
+        dictionary->map.size *= 2;
+        free(dictionary->map.slots);
+        dictionary->map.slots = calloc(dictionary->map.size, sizeof(*dictionary->map.slots));
+        dictionary->codes.strings = realloc(dictionary->codes.strings, sizeof(*dictionary->codes.strings) * dictionary->map.size / 2);
+
+        for (uint32_t code = 0; code < dictionary->codes.amount; ++code) {
+            storage_dictionary_map_insert(dictionary, code);
         }
+    }
 
-        switch (value->type) {
-            case STORAGE_COLUMN_TYPE_INT:
-                pointer = storage_write(row->table->storage->fd, &value->value._int, sizeof(value->value._int));
-                break;
+    dictionary->codes.strings[dictionary->codes.amount] = str;
+    storage_dictionary_map_insert(dictionary, dictionary->codes.amount++);
+}
 
-            case STORAGE_COLUMN_TYPE_UINT:
-                pointer = storage_write(row->table->storage->fd, &value->value.uint, sizeof(value->value.uint));
-                break;
+static struct storage_dictionary * storage_dictionary_new(uint64_t pointer) {
+    struct storage_dictionary * dictionary = malloc(sizeof(*dictionary));
 
-            case STORAGE_COLUMN_TYPE_NUM:
-                pointer = storage_write(row->table->storage->fd, &value->value.num, sizeof(value->value.num));
-                break;
+    dictionary->first_page = pointer;
+    dictionary->last_page = pointer;
+    dictionary->codes.amount = 0;
+    dictionary->codes.strings = malloc(sizeof(*dictionary->codes.strings) * STORAGE_DICTIONARY_INITIAL_SIZE / 2);
+    dictionary->map.size = STORAGE_DICTIONARY_INITIAL_SIZE;
+    dictionary->map.slots = calloc(dictionary->map.size, sizeof(*dictionary->map.slots));
 
-            case STORAGE_COLUMN_TYPE_STR:
-                pointer = storage_write_string(row->table->storage->fd, value->value.str);
-                break;
+    return dictionary;
+}
+
+static void storage_dictionary_delete(struct storage_dictionary * dictionary) {
+    if (dictionary) {
+        for (uint32_t code = 0; code < dictionary->codes.amount; ++code) {
+            free(dictionary->codes.strings[code]);
         }
+
+        free(dictionary->codes.strings);
+        free(dictionary->map.slots);
     }
 
-    lseek64(row->table->storage->fd, (off64_t) (row->position + (1 + index) * sizeof(uint64_t)), SEEK_SET);
-    write(row->table->storage->fd, &pointer, sizeof(pointer));
+    free(dictionary);
 }
 
-void storage_value_destroy(struct storage_value value) {
-    switch (value.type) {
-        case STORAGE_COLUMN_TYPE_STR:
-            free(value.value.str);
+static struct storage_dictionary * storage_dictionary_create(struct storage * storage) {
+    uint64_t pointer = storage_allocate(storage, 1);
+    uint16_t used = sizeof(struct storage_strings_header);
 
-        default:
-            break;
-    }
+    storage_write_at(storage, pointer + offsetof(struct storage_strings_header, used), &used, sizeof(used));
+    return storage_dictionary_new(pointer);
 }
 
-void storage_value_delete(struct storage_value * value) {
-    if (value) {
-        storage_value_destroy(*value);
-    }
+static struct storage_dictionary * storage_dictionary_load(struct storage * storage, uint64_t pointer) {
+    struct storage_dictionary * dictionary = storage_dictionary_new(pointer);
 
-    free(value);
-}
+    while (pointer) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_strings_header * header = (struct storage_strings_header *) page->data;
+
+        for (uint16_t offset = sizeof(*header); offset < header->used;) {
+            uint16_t length;
+            memcpy(&length, page->data + offset, sizeof(length));
+            offset += sizeof(length);
+
+            char * str = malloc(sizeof(*str) * (length + 1));
+            str[length] = '\0';
+
+            if (length > STORAGE_DICTIONARY_INLINE) {
+                uint64_t blob;
+                memcpy(&blob, page->data + offset, sizeof(blob));
+                offset += sizeof(blob);
+
+                pager_read(storage->pager, blob, str, length);
+            } else {
+                memcpy(str, page->data + offset, length);
+                offset += length;
+            }
 
-const char * storage_column_type_to_string(enum storage_column_type type) {
-    switch (type) {
-        case STORAGE_COLUMN_TYPE_INT:
-            return "int";
+            storage_dictionary_add(dictionary, str);
+        }
 
-        case STORAGE_COLUMN_TYPE_UINT:
-            return "uint";
+        dictionary->last_page = pointer;
+        pointer = header->next;
+        pager_unpin(storage->pager, page, false);
+    }
 
-        case STORAGE_COLUMN_TYPE_NUM:
-            return "num";
+    return dictionary;
+}
 
-        case STORAGE_COLUMN_TYPE_STR:
-            return "str";
+// Frees pages of the dictionary and blobs of its long strings
+static void storage_dictionary_destroy(struct storage * storage, struct storage_dictionary * dictionary) {
+    for (uint64_t pointer = dictionary->first_page; pointer;) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_strings_header * header = (struct storage_strings_header *) page->data;
+
+        for (uint16_t offset = sizeof(*header); offset < header->used;) {
+            uint16_t length;
+            memcpy(&length, page->data + offset, sizeof(length));
+            offset += sizeof(length);
+
+            if (length > STORAGE_DICTIONARY_INLINE) {
+                uint64_t blob;
+                memcpy(&blob, page->data + offset, sizeof(blob));
+                offset += sizeof(blob);
+
+                storage_free(storage, blob, storage_blob_pages(length));
+            } else {
+                offset += length;
+            }
+        }
 
-        default:
-            return NULL;
+        uint64_t next = header->next;
+        pager_unpin(storage->pager, page, false);
+
+        storage_free(storage, pointer, 1);
+        pointer = next;
     }
 }
 
+static bool storage_dictionary_find(const struct storage_dictionary * dictionary, const char * str, uint64_t * code) {
+    size_t mask = dictionary->map.size - 1;
 
-struct storage_joined_table * storage_joined_table_new(unsigned int amount) {
-    struct storage_joined_table * table = malloc(sizeof(*table));
+    for (size_t slot = storage_hash_bytes(str, strlen(str)) & mask; dictionary->map.slots[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t found = dictionary->map.slots[slot] - 1;
 
-    table->tables.amount = amount;
-    table->tables.tables = calloc(amount, sizeof(*table->tables.tables));
+        if (strcmp(dictionary->codes.strings[found], str) == 0) {
+            *code = found;
+            return true;
+        }
+    }
 
-    return table;
+    return false;
 }
 
-struct storage_joined_table * storage_joined_table_wrap(struct storage_table * table) {
-    if (!table) {
-        return NULL;
+// Returns the code of the string, a new string is appended to the last page of the dictionary
+static uint64_t storage_dictionary_encode(struct storage * storage, struct storage_dictionary * dictionary, const char * str) {
+    uint64_t code;
+    if (storage_dictionary_find(dictionary, str, &code)) {
+        return code;
     }
 
-    struct storage_joined_table * joined_table = storage_joined_table_new(1);
-    joined_table->tables.tables[0].table = table;
-    joined_table->tables.tables[0].t_column_index = 0;
-    joined_table->tables.tables[0].s_column_index = 0;
+    uint16_t length = (uint16_t) strlen(str);
+    uint16_t entry_length = sizeof(length) + (length > STORAGE_DICTIONARY_INLINE ? sizeof(uint64_t) : length);
 
-    return joined_table;
-}
+    // pages are allocated while no dictionary page is pinned
+    uint64_t blob = 0;
+    if (length > STORAGE_DICTIONARY_INLINE) {
+        blob = storage_allocate(storage, storage_blob_pages(length));
+        storage_write_at(storage, blob, str, length);
+    }
 
-void storage_joined_table_delete(struct storage_joined_table * table) {
-    if (table) {
-        for (int i = 0; i < table->tables.amount; ++i) {
-            storage_table_delete(table->tables.tables[i].table);
-        }
+    uint16_t used;
+    pager_read(storage->pager, dictionary->last_page + offsetof(struct storage_strings_header, used), &used, sizeof(used));
 
-        free(table->tables.tables);
+    if (used + entry_length > PAGER_PAGE_SIZE) {
+        uint64_t pointer = storage_allocate(storage, 1);
+        used = sizeof(struct storage_strings_header);
+
+        storage_write_at(storage, pointer + offsetof(struct storage_strings_header, used), &used, sizeof(used));
+        storage_write_at(storage, dictionary->last_page + offsetof(struct storage_strings_header, next), &pointer, sizeof(pointer));
+        dictionary->last_page = pointer;
     }
 
-    free(table);
-}
+    struct pager_page * page = storage_pin(storage, dictionary->last_page);
+    struct storage_strings_header * header = (struct storage_strings_header *) page->data;
 
-uint16_t storage_joined_table_get_columns_amount(struct storage_joined_table * table) {
-    uint16_t amount = 0;
+    memcpy(page->data + header->used, &length, sizeof(length));
+
+    if (blob != 0) {
+        memcpy(page->data + header->used + sizeof(length), &blob, sizeof(blob));
+    } else {
+        memcpy(page->data + header->used + sizeof(length), str, length);
+    }
+
+    header->used += entry_length;
+    pager_unpin(storage->pager, page, true);
+
+    storage_dictionary_add(dictionary, strdup(str));
+    return dictionary->codes.amount - 1;
+}
+
+// Returns true if string cells of the column refer to their values, not dictionary codes
+static bool storage_column_has_strings(const struct storage_table * table, uint16_t index) {
+    return table->columns.columns[index].type == STORAGE_COLUMN_TYPE_STR && !table->columns.columns[index].dictionary;
+}
+
+static size_t storage_record_length(const struct storage_table * table) {
+    size_t length = STORAGE_ALIGN(table->columns.amount * sizeof(uint64_t) + (table->columns.amount + 7) / 8);
+    return length > 0 ? length : sizeof(uint64_t);
+}
+
+static uint8_t * storage_record_nulls(const struct storage_table * table, uint8_t * record) {
+    return record + table->columns.amount * sizeof(uint64_t);
+}
+
+static bool storage_record_is_null(const struct storage_table * table, uint8_t * record, uint16_t index) {
+    return (storage_record_nulls(table, record)[index / 8] >> (index % 8)) & 1;
+}
+
+static void storage_record_set_null(const struct storage_table * table, uint8_t * record, uint16_t index, bool null) {
+    uint8_t * nulls = storage_record_nulls(table, record);
+
+    if (null) {
+        nulls[index / 8] |= (uint8_t) (1 << (index % 8));
+    } else {
+        nulls[index / 8] &= (uint8_t) ~(1 << (index % 8));
+    }
+}
+
+// Frees blobs of the record strings, only of the specified column unless it is UINT16_MAX
+static void storage_record_free_blobs(const struct storage_table * table, uint8_t * record, uint16_t index) {
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if ((index != UINT16_MAX && i != index) || !storage_column_has_strings(table, i)
+            || storage_record_is_null(table, record, i)) {
+            continue;
+        }
+
+        struct storage_string_cell string;
+        memcpy(&string, record + i * sizeof(uint64_t), sizeof(string));
+
+        if (string.offset == 0) {
+            storage_free(table->storage, (uint64_t) string.blob * PAGER_PAGE_SIZE, storage_blob_pages(string.length));
+        }
+    }
+}
+
+// Starts reading blobs of the record strings in the background
+static void storage_record_prefetch_blobs(const struct storage_table * table, uint8_t * record) {
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if (!storage_column_has_strings(table, i) || storage_record_is_null(table, record, i)) {
+            continue;
+        }
+
+        struct storage_string_cell string;
+        memcpy(&string, record + i * sizeof(uint64_t), sizeof(string));
+
+        if (string.offset == 0) {
+            pager_prefetch(table->storage->pager, string.blob, storage_blob_pages(string.length));
+        }
+    }
+}
+
+// Copies the record to the buffer without unused bytes between inline strings, returns its length
+static size_t storage_record_pack(const struct storage_table * table, const uint8_t * record, uint8_t * buffer) {
+    size_t record_length = storage_record_length(table);
+
+    memcpy(buffer, record, record_length);
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if (!storage_column_has_strings(table, i) || storage_record_is_null(table, buffer, i)) {
+            continue;
+        }
+
+        struct storage_string_cell string;
+        memcpy(&string, record + i * sizeof(uint64_t), sizeof(string));
+
+        if (string.offset == 0) {
+            continue;
+        }
+
+        memcpy(buffer + record_length, record + string.offset, string.length);
+        string.offset = record_length;
+        memcpy(buffer + i * sizeof(uint64_t), &string, sizeof(string));
+        record_length += string.length;
+    }
+
+    return record_length;
+}
+
+static size_t storage_table_header_length(const struct storage_table * table) {
+    size_t length = 6 * sizeof(uint64_t) + sizeof(uint16_t) + strlen(table->name) + sizeof(uint16_t) + sizeof(uint8_t);
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        length += sizeof(uint16_t) + strlen(table->columns.columns[i].name) + 2 * sizeof(uint8_t);
+
+        if (table->columns.columns[i].dictionary) {
+            length += sizeof(uint64_t);
+        }
+    }
+
+    return length;
+}
+
+static size_t storage_index_key_length(const struct storage_index * index) {
+    return index->table->columns.columns[index->column].type == STORAGE_COLUMN_TYPE_STR
+        ? STORAGE_INDEX_STRING_KEY_LENGTH : sizeof(uint64_t);
+}
+
+// Entry is the key followed by the row position, both in big endian to be compared with memcmp
+static size_t storage_index_entry_length(const struct storage_index * index) {
+    return storage_index_key_length(index) + sizeof(uint64_t);
+}
+
+// Items of inner nodes are entries followed by the pointer to the child with entries not less than them
+static size_t storage_index_item_length(const struct storage_index * index, bool leaf) {
+    return storage_index_entry_length(index) + (leaf ? 0 : sizeof(uint64_t));
+}
+
+static uint16_t storage_index_node_capacity(const struct storage_index * index, bool leaf) {
+    return (PAGER_PAGE_SIZE - sizeof(struct storage_index_node)) / storage_index_item_length(index, leaf);
+}
+
+static struct storage_index_node * storage_index_node(struct pager_page * page) {
+    return (struct storage_index_node *) page->data;
+}
+
+static uint8_t * storage_index_item(const struct storage_index * index, struct pager_page * page, uint16_t i) {
+    bool leaf = storage_index_node(page)->leaf;
+    return page->data + sizeof(struct storage_index_node) + i * storage_index_item_length(index, leaf);
+}
+
+static uint64_t storage_index_child(const struct storage_index * index, struct pager_page * page, uint16_t i) {
+    if (i == 0) {
+        return storage_index_node(page)->next;
+    }
+
+    uint64_t child;
+    memcpy(&child, storage_index_item(index, page, i - 1) + storage_index_entry_length(index), sizeof(child));
+    return child;
+}
+
+static void storage_index_put_u64(uint8_t * data, uint64_t value) {
+    for (int i = sizeof(value) - 1; i >= 0; --i) {
+        data[i] = (uint8_t) value;
+        value >>= 8;
+    }
+}
+
+static uint64_t storage_index_get_u64(const uint8_t * data) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        value = (value << 8) | data[i];
+    }
+
+    return value;
+}
+
+// Encodes the value so that the order of entries is the order of values, strings are cut to a prefix
+static void storage_index_encode(const struct storage_index * index, const struct storage_value * value, uint64_t position, uint8_t * entry) {
+    switch (value->type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            storage_index_put_u64(entry, (uint64_t) value->value._int ^ (1ULL << 63));
+            break;
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            storage_index_put_u64(entry, value->value.uint);
+            break;
+
+        case STORAGE_COLUMN_TYPE_NUM:
+        {
+            // -0.0 is equal to 0.0, so both have the same key
+            double num = value->value.num == 0 ? 0 : value->value.num;
+
+            uint64_t bits;
+            memcpy(&bits, &num, sizeof(bits));
+            storage_index_put_u64(entry, bits & (1ULL << 63) ? ~bits : bits ^ (1ULL << 63));
+            break;
+        }
+
+        case STORAGE_COLUMN_TYPE_STR:
+        {
+            size_t length = strlen(value->value.str);
+
+            memset(entry, 0, STORAGE_INDEX_STRING_KEY_LENGTH);
+            memcpy(entry, value->value.str, length < STORAGE_INDEX_STRING_KEY_LENGTH ? length : STORAGE_INDEX_STRING_KEY_LENGTH);
+            break;
+        }
+    }
+
+    storage_index_put_u64(entry + storage_index_key_length(index), position);
+}
+
+// Returns the first item of the node which entry is greater than the key, or not less if equal is set
+static uint16_t storage_index_node_search(const struct storage_index * index, struct pager_page * page, const uint8_t * key, bool equal) {
+    uint16_t left = 0, right = storage_index_node(page)->amount;
+    size_t length = storage_index_entry_length(index);
+
+    while (left < right) {
+        uint16_t middle = (left + right) / 2;
+        int cmp = memcmp(storage_index_item(index, page, middle), key, length);
+
+        if (cmp < 0 || (cmp == 0 && !equal)) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+
+    return left;
+}
+
+static uint64_t storage_index_allocate_node(struct storage * storage, bool leaf) {
+    uint64_t pointer = storage_allocate(storage, 1);
+
+    struct pager_page * page = storage_pin(storage, pointer);
+    storage_index_node(page)->leaf = leaf;
+    pager_unpin(storage->pager, page, true);
+
+    return pointer;
+}
+
+// Descends to the leaf which may contain the key, remembers the inner nodes on the way if path is set
+static uint64_t storage_index_find_leaf(const struct storage_index * index, const uint8_t * key, uint64_t * path, size_t * depth) {
+    struct storage * storage = index->table->storage;
+    uint64_t pointer = index->root;
+
+    while (true) {
+        struct pager_page * page = storage_pin(storage, pointer);
+
+        if (storage_index_node(page)->leaf) {
+            pager_unpin(storage->pager, page, false);
+            return pointer;
+        }
+
+        if (path) {
+            path[(*depth)++] = pointer;
+        }
+
+        uint64_t child = storage_index_child(index, page, storage_index_node_search(index, page, key, false));
+        pager_unpin(storage->pager, page, false);
+        pointer = child;
+    }
+}
+
+static void storage_index_write_root(struct storage_index * index) {
+    storage_write_at(index->table->storage, index->position + STORAGE_INDEX_HEADER_ROOT, &index->root, sizeof(index->root));
+    storage_write_at(index->table->storage, index->position + STORAGE_INDEX_HEADER_DEPTH, &index->depth, sizeof(index->depth));
+}
+
+static void storage_index_insert(struct storage_index * index, const uint8_t * entry) {
+    struct storage * storage = index->table->storage;
+    size_t entry_length = storage_index_entry_length(index);
+
+    uint64_t path[STORAGE_INDEX_MAX_DEPTH];
+    size_t depth = 0;
+    uint64_t pointer = storage_index_find_leaf(index, entry, path, &depth);
+
+    uint8_t item[STORAGE_INDEX_STRING_KEY_LENGTH + 2 * sizeof(uint64_t)];
+    memcpy(item, entry, entry_length);
+    bool leaf = true;
+
+    while (true) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_index_node * node = storage_index_node(page);
+        size_t item_length = storage_index_item_length(index, leaf);
+        uint16_t at = storage_index_node_search(index, page, item, leaf);
+
+        if (node->amount < storage_index_node_capacity(index, leaf)) {
+            uint8_t * place = storage_index_item(index, page, at);
+
+            memmove(place + item_length, place, (node->amount - at) * item_length);
+            memcpy(place, item, item_length);
+            ++node->amount;
+
+            pager_unpin(storage->pager, page, true);
+            return;
+        }
+
+        // the full node is split in halves, the first entry of the right half goes to the parent
+        uint8_t buffer[PAGER_PAGE_SIZE + sizeof(item)];
+        uint8_t * items = storage_index_item(index, page, 0);
+        uint16_t amount = node->amount + 1;
+
+        memcpy(buffer, items, at * item_length);
+        memcpy(buffer + at * item_length, item, item_length);
+        memcpy(buffer + (at + 1) * item_length, items + at * item_length, (node->amount - at) * item_length);
+
+        uint64_t right_pointer = storage_index_allocate_node(storage, leaf);
+        struct pager_page * right_page = storage_pin(storage, right_pointer);
+        struct storage_index_node * right = storage_index_node(right_page);
+
+        uint16_t left_amount = amount / 2;
+        uint8_t * separator = buffer + left_amount * item_length;
+        memcpy(item, separator, entry_length);
+
+        node->amount = left_amount;
+        memcpy(items, buffer, left_amount * item_length);
+
+        if (leaf) {
+            right->amount = amount - left_amount;
+            right->next = node->next;
+            node->next = right_pointer;
+            memcpy(storage_index_item(index, right_page, 0), separator, right->amount * item_length);
+        } else {
+            right->amount = amount - left_amount - 1;
+            memcpy(&right->next, separator + entry_length, sizeof(right->next));
+            memcpy(storage_index_item(index, right_page, 0), separator + item_length, right->amount * item_length);
+        }
+
+        pager_unpin(storage->pager, right_page, true);
+        pager_unpin(storage->pager, page, true);
+        memcpy(item + entry_length, &right_pointer, sizeof(right_pointer));
+
+        if (depth == 0) {
+            uint64_t root = storage_index_allocate_node(storage, false);
+            struct pager_page * root_page = storage_pin(storage, root);
+
+            storage_index_node(root_page)->next = pointer;
+            storage_index_node(root_page)->amount = 1;
+            memcpy(storage_index_item(index, root_page, 0), item, entry_length + sizeof(uint64_t));
+            pager_unpin(storage->pager, root_page, true);
+
+            index->root = root;
+            storage_index_write_root(index);
+            return;
+        }
+
+        pointer = path[--depth];
+        leaf = false;
+    }
+}
+
+// Removes the entry from its leaf, emptied leaves are left in the tree until it is rebuilt
+static void storage_index_remove(struct storage_index * index, const uint8_t * entry) {
+    struct storage * storage = index->table->storage;
+    size_t entry_length = storage_index_entry_length(index);
+
+    struct pager_page * page = storage_pin(storage, storage_index_find_leaf(index, entry, NULL, NULL));
+    struct storage_index_node * node = storage_index_node(page);
+    uint16_t at = storage_index_node_search(index, page, entry, true);
+
+    if (at < node->amount && memcmp(storage_index_item(index, page, at), entry, entry_length) == 0) {
+        uint8_t * place = storage_index_item(index, page, at);
+
+        memmove(place, place + entry_length, (node->amount - at - 1) * entry_length);
+        --node->amount;
+    }
+
+    pager_unpin(storage->pager, page, true);
+}
+
+static void storage_index_free_node(struct storage_index * index, uint64_t pointer) {
+    struct storage * storage = index->table->storage;
+    struct pager_page * page = storage_pin(storage, pointer);
+
+    if (!storage_index_node(page)->leaf) {
+        for (uint16_t i = 0; i <= storage_index_node(page)->amount; ++i) {
+            storage_index_free_node(index, storage_index_child(index, page, i));
+        }
+    }
+
+    pager_unpin(storage->pager, page, false);
+    storage_free(storage, pointer, 1);
+}
+
+static uint64_t storage_hash_value(const struct storage_index * index, const struct storage_value * value) {
+    if (value->type == STORAGE_COLUMN_TYPE_STR) {
+        return storage_hash_bytes(value->value.str, strlen(value->value.str));
+    }
+
+    uint8_t entry[sizeof(uint64_t) * 2];
+    storage_index_encode(index, value, 0, entry);
+    return storage_hash_bytes(entry, sizeof(uint64_t));
+}
+
+static struct storage_hash_bucket * storage_hash_bucket(struct pager_page * page) {
+    return (struct storage_hash_bucket *) page->data;
+}
+
+static struct storage_hash_entry * storage_hash_entries(struct pager_page * page) {
+    return (struct storage_hash_entry *) (page->data + sizeof(struct storage_hash_bucket));
+}
+
+static uint64_t storage_hash_directory_get(struct storage_index * index, uint64_t slot) {
+    uint64_t pointer;
+    pager_read(index->table->storage->pager, index->root + slot * sizeof(pointer), &pointer, sizeof(pointer));
+    return pointer;
+}
+
+static void storage_hash_directory_set(struct storage_index * index, uint64_t slot, uint64_t pointer) {
+    storage_write_at(index->table->storage, index->root + slot * sizeof(pointer), &pointer, sizeof(pointer));
+}
+
+static size_t storage_hash_directory_pages(uint8_t depth) {
+    return ((sizeof(uint64_t) << depth) + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE;
+}
+
+static uint64_t storage_hash_allocate_bucket(struct storage * storage, uint16_t depth) {
+    uint64_t pointer = storage_allocate(storage, 1);
+
+    struct pager_page * page = storage_pin(storage, pointer);
+    storage_hash_bucket(page)->depth = depth;
+    pager_unpin(storage->pager, page, true);
+
+    return pointer;
+}
+
+// Places the entry to the first page of the bucket chain with free space, extends the chain if there is none
+static void storage_hash_chain_add(struct storage * storage, uint64_t pointer, struct storage_hash_entry entry) {
+    while (true) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_hash_bucket * bucket = storage_hash_bucket(page);
+
+        if (bucket->amount < STORAGE_HASH_BUCKET_CAPACITY) {
+            storage_hash_entries(page)[bucket->amount++] = entry;
+            pager_unpin(storage->pager, page, true);
+            return;
+        }
+
+        if (bucket->next == 0) {
+            bucket->next = storage_hash_allocate_bucket(storage, bucket->depth);
+        }
+
+        uint64_t next = bucket->next;
+        pager_unpin(storage->pager, page, true);
+        pointer = next;
+    }
+}
+
+static void storage_hash_chain_free(struct storage * storage, uint64_t pointer) {
+    while (pointer) {
+        uint64_t next;
+        pager_read(storage->pager, pointer, &next, sizeof(next));
+
+        storage_free(storage, pointer, 1);
+        pointer = next;
+    }
+}
+
+static void storage_hash_double_directory(struct storage_index * index) {
+    struct storage * storage = index->table->storage;
+    uint64_t amount = 1ULL << index->depth;
+
+    uint64_t directory = storage_allocate(storage, storage_hash_directory_pages(index->depth + 1));
+    for (uint64_t slot = 0; slot < amount; ++slot) {
+        uint64_t pointer = storage_hash_directory_get(index, slot);
+
+        storage_write_at(storage, directory + slot * sizeof(pointer), &pointer, sizeof(pointer));
+        storage_write_at(storage, directory + (slot + amount) * sizeof(pointer), &pointer, sizeof(pointer));
+    }
+
+    storage_free(storage, index->root, storage_hash_directory_pages(index->depth));
+
+    index->root = directory;
+    ++index->depth;
+    storage_index_write_root(index);
+}
+
+// Splits the bucket of the slot by the next bit of hashes, returns false if it can't separate the entries
+static bool storage_hash_split(struct storage_index * index, uint64_t slot) {
+    struct storage * storage = index->table->storage;
+    uint64_t pointer = storage_hash_directory_get(index, slot);
+
+    struct pager_page * page = storage_pin(storage, pointer);
+    struct storage_hash_bucket * bucket = storage_hash_bucket(page);
+    uint16_t depth = bucket->depth;
+
+    bool separable = false;
+    for (uint16_t i = 1; i < bucket->amount; ++i) {
+        separable = separable || storage_hash_entries(page)[i].hash != storage_hash_entries(page)[0].hash;
+    }
+
+    if (!separable || depth >= STORAGE_HASH_MAX_DEPTH) {
+        pager_unpin(storage->pager, page, false);
+        return false;
+    }
+
+    // entries of the whole chain are collected and distributed between the two new chains
+    size_t amount = 0, capacity = STORAGE_HASH_BUCKET_CAPACITY;
+    struct storage_hash_entry * entries = malloc(sizeof(*entries) * capacity);
+
+    for (uint64_t chain = bucket->next; true;) {
+        if (amount + bucket->amount > capacity) {
+            capacity = 2 * (amount + bucket->amount);
+            entries = realloc(entries, sizeof(*entries) * capacity);
+        }
+
+        memcpy(entries + amount, storage_hash_entries(page), sizeof(*entries) * bucket->amount);
+        amount += bucket->amount;
+
+        if (chain == 0) {
+            break;
+        }
+
+        pager_unpin(storage->pager, page, false);
+        page = storage_pin(storage, chain);
+        bucket = storage_hash_bucket(page);
+        chain = bucket->next;
+    }
+
+    pager_unpin(storage->pager, page, false);
+
+    page = storage_pin(storage, pointer);
+    bucket = storage_hash_bucket(page);
+    storage_hash_chain_free(storage, bucket->next);
+    bucket->next = 0;
+    bucket->amount = 0;
+    bucket->depth = depth + 1;
+    pager_unpin(storage->pager, page, true);
+
+    if (depth == index->depth) {
+        storage_hash_double_directory(index);
+    }
+
+    uint64_t sibling = storage_hash_allocate_bucket(storage, depth + 1);
+    uint64_t low = slot & ((1ULL << depth) - 1);
+
+    for (uint64_t i = low | (1ULL << depth); i < (1ULL << index->depth); i += 1ULL << (depth + 1)) {
+        storage_hash_directory_set(index, i, sibling);
+    }
+
+    for (size_t i = 0; i < amount; ++i) {
+        storage_hash_chain_add(storage, (entries[i].hash >> depth) & 1 ? sibling : pointer, entries[i]);
+    }
+
+    free(entries);
+    return true;
+}
+
+static void storage_hash_insert(struct storage_index * index, uint64_t hash, uint64_t position) {
+    struct storage * storage = index->table->storage;
+    struct storage_hash_entry entry = { .hash = hash, .position = position };
+
+    while (true) {
+        uint64_t slot = hash & ((1ULL << index->depth) - 1);
+        uint64_t pointer = storage_hash_directory_get(index, slot);
+
+        struct pager_page * page = storage_pin(storage, pointer);
+        bool full = storage_hash_bucket(page)->amount == STORAGE_HASH_BUCKET_CAPACITY;
+        pager_unpin(storage->pager, page, false);
+
+        // duplicated hashes which can't be split go to overflow pages of the bucket
+        if (!full || !storage_hash_split(index, slot)) {
+            storage_hash_chain_add(storage, pointer, entry);
+            return;
+        }
+    }
+}
+
+static void storage_hash_remove(struct storage_index * index, uint64_t hash, uint64_t position) {
+    struct storage * storage = index->table->storage;
+    uint64_t pointer = storage_hash_directory_get(index, hash & ((1ULL << index->depth) - 1));
+
+    while (pointer) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_hash_bucket * bucket = storage_hash_bucket(page);
+        struct storage_hash_entry * entries = storage_hash_entries(page);
+
+        for (uint16_t i = 0; i < bucket->amount; ++i) {
+            if (entries[i].hash == hash && entries[i].position == position) {
+                entries[i] = entries[--bucket->amount];
+                pager_unpin(storage->pager, page, true);
+                return;
+            }
+        }
+
+        pointer = bucket->next;
+        pager_unpin(storage->pager, page, false);
+    }
+}
+
+static uint64_t * storage_hash_find(struct storage_index * index, uint64_t hash, size_t * amount) {
+    struct storage * storage = index->table->storage;
+    uint64_t pointer = storage_hash_directory_get(index, hash & ((1ULL << index->depth) - 1));
+
+    size_t capacity = 16;
+    uint64_t * positions = malloc(sizeof(*positions) * capacity);
+    *amount = 0;
+
+    while (pointer) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_hash_bucket * bucket = storage_hash_bucket(page);
+
+        for (uint16_t i = 0; i < bucket->amount; ++i) {
+            if (storage_hash_entries(page)[i].hash != hash) {
+                continue;
+            }
+
+            if (*amount == capacity) {
+                capacity *= 2;
+                positions = realloc(positions, sizeof(*positions) * capacity);
+            }
+
+            positions[(*amount)++] = storage_hash_entries(page)[i].position;
+        }
+
+        pointer = bucket->next;
+        pager_unpin(storage->pager, page, false);
+    }
+
+    return positions;
+}
+
+static void storage_hash_free(struct storage_index * index) {
+    struct storage * storage = index->table->storage;
+
+    for (uint64_t slot = 0; slot < (1ULL << index->depth); ++slot) {
+        uint64_t pointer = storage_hash_directory_get(index, slot);
+
+        struct pager_page * page = storage_pin(storage, pointer);
+        uint16_t depth = storage_hash_bucket(page)->depth;
+        pager_unpin(storage->pager, page, false);
+
+        // a bucket is shared by all slots with the same low bits, it is freed with the first one
+        if (slot < (1ULL << depth)) {
+            storage_hash_chain_free(storage, pointer);
+        }
+    }
+
+    storage_free(storage, index->root, storage_hash_directory_pages(index->depth));
+}
+
+// Allocates an empty structure of the index
+static void storage_index_init(struct storage_index * index) {
+    struct storage * storage = index->table->storage;
+
+    switch (index->type) {
+        case STORAGE_INDEX_TYPE_BTREE:
+            index->root = storage_index_allocate_node(storage, true);
+            break;
+
+        case STORAGE_INDEX_TYPE_HASH:
+            index->depth = 0;
+            index->root = storage_allocate(storage, storage_hash_directory_pages(0));
+            storage_hash_directory_set(index, 0, storage_hash_allocate_bucket(storage, 0));
+            break;
+    }
+}
+
+// Frees all pages of the index structure
+static void storage_index_destroy(struct storage_index * index) {
+    switch (index->type) {
+        case STORAGE_INDEX_TYPE_BTREE:
+            storage_index_free_node(index, index->root);
+            break;
+
+        case STORAGE_INDEX_TYPE_HASH:
+            storage_hash_free(index);
+            break;
+    }
+}
+
+static void storage_index_update(struct storage_index * index, const struct storage_value * value, uint64_t position, bool insert) {
+    switch (index->type) {
+        case STORAGE_INDEX_TYPE_BTREE:
+        {
+            uint8_t entry[STORAGE_INDEX_STRING_KEY_LENGTH + sizeof(uint64_t)];
+            storage_index_encode(index, value, position, entry);
+
+            if (insert) {
+                storage_index_insert(index, entry);
+            } else {
+                storage_index_remove(index, entry);
+            }
+
+            break;
+        }
+
+        case STORAGE_INDEX_TYPE_HASH:
+            if (insert) {
+                storage_hash_insert(index, storage_hash_value(index, value), position);
+            } else {
+                storage_hash_remove(index, storage_hash_value(index, value), position);
+            }
+
+            break;
+    }
+}
+
+// Adds or removes entries of the value of the row to indexes of the column
+static void storage_table_index_value(struct storage_table * table, uint16_t column, uint64_t position, const struct storage_value * value, bool insert) {
+    if (!value) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        struct storage_index * index = table->indexes.indexes[i];
+
+        if (index->column != column) {
+            continue;
+        }
+
+        storage_index_update(index, value, position, insert);
+    }
+}
+
+static bool storage_table_is_indexed(struct storage_table * table, uint16_t column) {
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        if (table->indexes.indexes[i]->column == column) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Inserts entries of all rows of the table to the empty index
+static void storage_index_build(struct storage_index * index) {
+    for (struct storage_row * row = storage_table_get_first_row(index->table); row; row = storage_row_next(row)) {
+        struct storage_value * value = storage_row_get_value(row, index->column);
+
+        if (value) {
+            storage_index_update(index, value, row->position, true);
+        }
+
+        storage_value_delete(value);
+    }
+}
+
+// Replaces the tree of the index with an empty one
+static void storage_index_clear(struct storage_index * index) {
+    storage_index_destroy(index);
+    storage_index_init(index);
+    storage_index_write_root(index);
+}
+
+static struct storage_index * storage_index_load(struct storage_table * table, uint64_t pointer) {
+    uint64_t offset = pointer;
+
+    struct storage_index * index = malloc(sizeof(*index));
+    index->table = table;
+    index->position = pointer;
+
+    storage_read(table->storage, &offset, &index->next, sizeof(index->next));
+    storage_read(table->storage, &offset, &index->root, sizeof(index->root));
+    storage_read(table->storage, &offset, &index->column, sizeof(index->column));
+
+    uint8_t type;
+    storage_read(table->storage, &offset, &type, sizeof(type));
+    index->type = (enum storage_index_type) type;
+    storage_read(table->storage, &offset, &index->depth, sizeof(index->depth));
+    index->name = storage_read_string(table->storage, &offset);
+
+    return index;
+}
+
+static void storage_index_delete(struct storage_index * index) {
+    if (index) {
+        free(index->name);
+    }
+
+    free(index);
+}
+
+static size_t storage_stats_pages(const struct storage_table * table) {
+    return (sizeof(uint64_t) + table->columns.amount * STORAGE_STATS_COLUMN_LENGTH + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE;
+}
+
+static void storage_stats_reset(struct storage_table * table) {
+    table->stats.rows = 0;
+    table->stats.dirty = true;
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        struct storage_column_stats * stats = &table->stats.columns[i];
+
+        stats->nulls = 0;
+        stats->bounded = false;
+        stats->min.type = stats->max.type = table->columns.columns[i].type;
+        memset(stats->sketch, 0, sizeof(stats->sketch));
+    }
+}
+
+static void storage_stats_load(struct storage_table * table) {
+    uint64_t offset = table->stats.position;
+
+    table->stats.dirty = false;
+    table->stats.columns = malloc(sizeof(*table->stats.columns) * table->columns.amount);
+    storage_read(table->storage, &offset, &table->stats.rows, sizeof(table->stats.rows));
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        struct storage_column_stats * stats = &table->stats.columns[i];
+        uint64_t bounded;
+
+        storage_read(table->storage, &offset, &stats->nulls, sizeof(stats->nulls));
+        storage_read(table->storage, &offset, &bounded, sizeof(bounded));
+        storage_read(table->storage, &offset, &stats->min.value, sizeof(uint64_t));
+        storage_read(table->storage, &offset, &stats->max.value, sizeof(uint64_t));
+        storage_read(table->storage, &offset, stats->sketch, sizeof(stats->sketch));
+
+        stats->bounded = bounded != 0;
+        stats->min.type = stats->max.type = table->columns.columns[i].type;
+    }
+}
+
+static void storage_stats_write(struct storage_table * table) {
+    size_t length = storage_stats_pages(table) * PAGER_PAGE_SIZE;
+    uint8_t * data = malloc(length);
+    size_t offset = 0;
+
+    storage_put(data, &offset, &table->stats.rows, sizeof(table->stats.rows));
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        struct storage_column_stats * stats = &table->stats.columns[i];
+        uint64_t bounded = stats->bounded;
+
+        storage_put(data, &offset, &stats->nulls, sizeof(stats->nulls));
+        storage_put(data, &offset, &bounded, sizeof(bounded));
+        storage_put(data, &offset, &stats->min.value, sizeof(uint64_t));
+        storage_put(data, &offset, &stats->max.value, sizeof(uint64_t));
+        storage_put(data, &offset, stats->sketch, sizeof(stats->sketch));
+    }
+
+    storage_write_at(table->storage, table->stats.position, data, offset);
+    table->stats.dirty = false;
+    free(data);
+}
+
+static int storage_stats_compare(const struct storage_value * a, const struct storage_value * b) {
+    switch (a->type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            return (a->value._int > b->value._int) - (a->value._int < b->value._int);
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            return (a->value.uint > b->value.uint) - (a->value.uint < b->value.uint);
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            return (a->value.num > b->value.num) - (a->value.num < b->value.num);
+
+        default:
+            return 0;
+    }
+}
+
+// Counts the value of the column, it is called for every new value
+static void storage_stats_add(struct storage_table * table, uint16_t column, const struct storage_value * value) {
+    struct storage_column_stats * stats = &table->stats.columns[column];
+    table->stats.dirty = true;
+
+    if (!value) {
+        ++stats->nulls;
+        return;
+    }
+
+    uint64_t hash;
+    if (value->type == STORAGE_COLUMN_TYPE_STR) {
+        hash = storage_hash_bytes(value->value.str, strlen(value->value.str));
+    } else {
+        hash = storage_hash_bytes(&value->value, sizeof(uint64_t));
+
+        if (!stats->bounded || storage_stats_compare(value, &stats->min) < 0) {
+            stats->min = *value;
+        }
+
+        if (!stats->bounded || storage_stats_compare(value, &stats->max) > 0) {
+            stats->max = *value;
+        }
+
+        stats->bounded = true;
+    }
+
+    // the register is chosen by the low bits of the hash, the rank is the position of the lowest set bit of the rest
+    uint64_t rest = hash / STORAGE_STATS_SKETCH_SIZE;
+    uint8_t rank = rest ? (uint8_t) (__builtin_ctzll(rest) + 1) : 64;
+    uint8_t * sketch = &stats->sketch[hash % STORAGE_STATS_SKETCH_SIZE];
+
+    if (rank > *sketch) {
+        *sketch = rank;
+    }
+}
+
+// Forgets the removed value, min, max and distinct values are kept as bounds
+static void storage_stats_remove(struct storage_table * table, uint16_t column, bool null) {
+    if (null) {
+        --table->stats.columns[column].nulls;
+        table->stats.dirty = true;
+    }
+}
+
+uint64_t storage_column_stats_distinct(const struct storage_column_stats * stats) {
+    // HyperLogLog estimate with linear counting for small cardinalities
+    double sum = 0;
+    unsigned int zeros = 0;
+
+    for (size_t i = 0; i < STORAGE_STATS_SKETCH_SIZE; ++i) {
+        sum += 1.0 / (double) (1ULL << (stats->sketch[i] < 63 ? stats->sketch[i] : 63));
+        zeros += stats->sketch[i] == 0;
+    }
+
+    double m = STORAGE_STATS_SKETCH_SIZE;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+
+    return (uint64_t) (estimate + 0.5);
+}
+
+static struct storage_table * storage_table_load(struct storage * storage, uint64_t pointer) {
+    uint64_t offset = pointer;
+
+    struct storage_table * table = malloc(sizeof(*table));
+    table->storage = storage;
+    table->position = pointer;
+    table->next_in_bucket = NULL;
+
+    storage_read(storage, &offset, &table->next, sizeof(table->next));
+    storage_read(storage, &offset, &table->first_page, sizeof(table->first_page));
+    storage_read(storage, &offset, &table->last_page, sizeof(table->last_page));
+    storage_read(storage, &offset, &table->free_page, sizeof(table->free_page));
+    storage_read(storage, &offset, &table->first_index, sizeof(table->first_index));
+    storage_read(storage, &offset, &table->stats.position, sizeof(table->stats.position));
+    table->name = storage_read_string(storage, &offset);
+
+    storage_read(storage, &offset, &table->columns.amount, sizeof(table->columns.amount));
+    table->columns.columns = malloc(sizeof(*table->columns.columns) * table->columns.amount);
+    table->dictionaries = calloc(table->columns.amount, sizeof(*table->dictionaries));
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        table->columns.columns[i].name = storage_read_string(storage, &offset);
+
+        uint8_t type, flags;
+        storage_read(storage, &offset, &type, sizeof(type));
+        storage_read(storage, &offset, &flags, sizeof(flags));
+        table->columns.columns[i].type = (enum storage_column_type) type;
+        table->columns.columns[i].dictionary = flags & STORAGE_COLUMN_DICTIONARY;
+
+        if (table->columns.columns[i].dictionary) {
+            uint64_t dictionary;
+            storage_read(storage, &offset, &dictionary, sizeof(dictionary));
+            table->dictionaries[i] = storage_dictionary_load(storage, dictionary);
+        }
+    }
+
+    uint8_t format;
+    storage_read(storage, &offset, &format, sizeof(format));
+    table->format = (enum storage_table_format) format;
+
+    storage_stats_load(table);
+
+    table->indexes.amount = 0;
+    table->indexes.indexes = NULL;
+
+    for (uint64_t pointer = table->first_index; pointer;) {
+        struct storage_index * index = storage_index_load(table, pointer);
+
+        table->indexes.indexes = realloc(table->indexes.indexes, sizeof(*table->indexes.indexes) * (table->indexes.amount + 1));
+        table->indexes.indexes[table->indexes.amount++] = index;
+        pointer = index->next;
+    }
+
+    return table;
+}
+
+struct storage_table * storage_find_table(struct storage * storage, const char * name) {
+    struct storage_table * table = storage->tables.buckets[storage_catalog_hash(name) % storage->tables.size];
+
+    while (table && strcmp(table->name, name) != 0) {
+        table = table->next_in_bucket;
+    }
+
+    return table;
+}
+
+void storage_table_delete(struct storage_table * table) {
+    if (table) {
+        free(table->name);
+
+        for (uint16_t i = 0; i < table->columns.amount; ++i) {
+            free(table->columns.columns[i].name);
+        }
+
+        free(table->columns.columns);
+
+        if (table->dictionaries) {
+            for (uint16_t i = 0; i < table->columns.amount; ++i) {
+                storage_dictionary_delete(table->dictionaries[i]);
+            }
+        }
+
+        free(table->dictionaries);
+        free(table->stats.columns);
+
+        for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+            storage_index_delete(table->indexes.indexes[i]);
+        }
+
+        free(table->indexes.indexes);
+    }
+
+    free(table);
+}
+
+static void storage_table_write_pages(struct storage_table * table) {
+    uint64_t pages[3] = { table->first_page, table->last_page, table->free_page };
+    storage_write_at(table->storage, table->position + STORAGE_TABLE_HEADER_FIRST_PAGE, pages, sizeof(pages));
+}
+
+void storage_table_add(struct storage_table * table) {
+    if (storage_find_table(table->storage, table->name) != NULL) {
+        errno = EINVAL;
+        return;
+    }
+
+    // only strings are encoded with dictionaries
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        table->columns.columns[i].dictionary &= table->columns.columns[i].type == STORAGE_COLUMN_TYPE_STR;
+    }
+
+    if (storage_table_header_length(table) > PAGER_PAGE_SIZE
+        || storage_record_length(table) + sizeof(struct storage_page_header) + sizeof(struct storage_slot) > PAGER_PAGE_SIZE
+        || (table->format == STORAGE_TABLE_FORMAT_COLUMNS && table->columns.amount > STORAGE_SEGMENT_MAX_COLUMNS)) {
+        errno = E2BIG;
+        return;
+    }
+
+    table->next = table->storage->first_table;
+    table->first_page = 0;
+    table->last_page = 0;
+    table->free_page = 0;
+    table->first_index = 0;
+    table->indexes.amount = 0;
+    table->indexes.indexes = NULL;
+    table->position = storage_allocate(table->storage, 1);
+    table->dictionaries = calloc(table->columns.amount, sizeof(*table->dictionaries));
+    table->stats.position = storage_allocate(table->storage, storage_stats_pages(table));
+    table->stats.columns = malloc(sizeof(*table->stats.columns) * table->columns.amount);
+    storage_stats_reset(table);
+
+    struct pager_page * page = storage_pin(table->storage, table->position);
+    size_t offset = 0;
+
+    storage_put(page->data, &offset, &table->next, sizeof(table->next));
+    storage_put(page->data, &offset, &table->first_page, sizeof(table->first_page));
+    storage_put(page->data, &offset, &table->last_page, sizeof(table->last_page));
+    storage_put(page->data, &offset, &table->free_page, sizeof(table->free_page));
+    storage_put(page->data, &offset, &table->first_index, sizeof(table->first_index));
+    storage_put(page->data, &offset, &table->stats.position, sizeof(table->stats.position));
+    storage_put_string(page->data, &offset, table->name);
+    storage_put(page->data, &offset, &table->columns.amount, sizeof(table->columns.amount));
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        storage_put_string(page->data, &offset, table->columns.columns[i].name);
+
+        uint8_t type = table->columns.columns[i].type;
+        uint8_t flags = table->columns.columns[i].dictionary ? STORAGE_COLUMN_DICTIONARY : 0;
+        storage_put(page->data, &offset, &type, sizeof(type));
+        storage_put(page->data, &offset, &flags, sizeof(flags));
+
+        if (table->columns.columns[i].dictionary) {
+            table->dictionaries[i] = storage_dictionary_create(table->storage);
+            storage_put(page->data, &offset, &table->dictionaries[i]->first_page, sizeof(table->dictionaries[i]->first_page));
+        }
+    }
+
+    uint8_t format = table->format;
+    storage_put(page->data, &offset, &format, sizeof(format));
+
+    pager_unpin(table->storage->pager, page, true);
+
+    table->storage->first_table = table->position;
+    storage_write_at(table->storage, STORAGE_HEADER_FIRST_TABLE, &table->position, sizeof(table->position));
+
+    storage_catalog_insert(table->storage, table);
+}
+
+static struct storage_segment_header * storage_segment_header(struct pager_page * page) {
+    return (struct storage_segment_header *) page->data;
+}
+
+// Bitmap of live rows for the column UINT16_MAX, bitmap of NULL cells for others
+static uint8_t * storage_segment_bitmap(struct pager_page * page, uint16_t column) {
+    return page->data + sizeof(struct storage_segment_header) + (column == UINT16_MAX ? 0 : column + 1) * STORAGE_SEGMENT_BITMAP;
+}
+
+static bool storage_bitmap_get(const uint8_t * bits, uint16_t index) {
+    return (bits[index / 8] >> (index % 8)) & 1;
+}
+
+static void storage_bitmap_set(uint8_t * bits, uint16_t index, bool value) {
+    if (value) {
+        bits[index / 8] |= (uint8_t) (1 << (index % 8));
+    } else {
+        bits[index / 8] &= (uint8_t) ~(1 << (index % 8));
+    }
+}
+
+static uint64_t storage_segment_column(uint64_t segment, uint16_t column) {
+    return segment + (uint64_t) (column + 1) * PAGER_PAGE_SIZE;
+}
+
+// Zone map of the column: the min and the max cells of its values in the segment, kept after the null bitmaps
+static uint8_t * storage_segment_zone(struct storage_table * table, struct pager_page * page, uint16_t column) {
+    return storage_segment_bitmap(page, (uint16_t) table->columns.amount) + column * STORAGE_SEGMENT_ZONE;
+}
+
+static void storage_segment_get_zone(struct storage_table * table, struct pager_page * page, uint16_t column,
+    struct storage_value * min, struct storage_value * max) {
+
+    const uint8_t * zone = storage_segment_zone(table, page, column);
+
+    min->type = max->type = table->columns.columns[column].type;
+    memcpy(&min->value, zone, sizeof(uint64_t));
+    memcpy(&max->value, zone + sizeof(uint64_t), sizeof(uint64_t));
+}
+
+static void storage_segment_set_zone(struct storage_table * table, struct pager_page * page, uint16_t column,
+    const struct storage_value * min, const struct storage_value * max) {
+
+    uint8_t * zone = storage_segment_zone(table, page, column);
+
+    memcpy(zone, &min->value, sizeof(uint64_t));
+    memcpy(zone + sizeof(uint64_t), &max->value, sizeof(uint64_t));
+}
+
+// Makes zone maps of numeric columns of the new segment empty: the min is above and the max is below all values
+static void storage_segment_clear_zones(struct storage_table * table, struct pager_page * page) {
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        struct storage_value min = { .type = table->columns.columns[i].type };
+        struct storage_value max = { .type = min.type };
+
+        switch (min.type) {
+            case STORAGE_COLUMN_TYPE_INT:
+                min.value._int = INT64_MAX;
+                max.value._int = INT64_MIN;
+                break;
+
+            case STORAGE_COLUMN_TYPE_UINT:
+                min.value.uint = UINT64_MAX;
+                max.value.uint = 0;
+                break;
+
+            case STORAGE_COLUMN_TYPE_NUM:
+                min.value.num = INFINITY;
+                max.value.num = -INFINITY;
+                break;
+
+            case STORAGE_COLUMN_TYPE_STR:
+                continue;
+        }
+
+        storage_segment_set_zone(table, page, i, &min, &max);
+    }
+}
+
+// Widens the zone map of the column by the new value, zone maps are never narrowed until the rows are vacuumed
+static void storage_segment_widen_zone(struct storage_table * table, struct pager_page * page, uint16_t column,
+    const struct storage_value * value) {
+
+    // NaN is in no range of values, so it is kept out of zone maps like NULL
+    if (value->type == STORAGE_COLUMN_TYPE_NUM && isnan(value->value.num)) {
+        return;
+    }
+
+    struct storage_value min, max;
+    storage_segment_get_zone(table, page, column, &min, &max);
+
+    if (storage_stats_compare(value, &min) < 0) {
+        min = *value;
+    }
+
+    if (storage_stats_compare(value, &max) > 0) {
+        max = *value;
+    }
+
+    storage_segment_set_zone(table, page, column, &min, &max);
+}
+
+// Returns false if the zone maps of the segment show that none of its rows is in the ranges of the row,
+// rows with NaN or NULL are skipped with the segment as they are in no range
+static bool storage_segment_in_ranges(struct storage_row * row, struct pager_page * page) {
+    for (size_t i = 0; i < row->ranges.amount; ++i) {
+        const struct storage_range * range = &row->ranges.ranges[i];
+
+        if (row->table->columns.columns[range->column].type == STORAGE_COLUMN_TYPE_STR) {
+            continue;
+        }
+
+        struct storage_value min, max;
+        storage_segment_get_zone(row->table, page, range->column, &min, &max);
+
+        if ((range->has_from && storage_stats_compare(&max, &range->from) < 0)
+            || (range->has_to && storage_stats_compare(&min, &range->to) > 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint64_t storage_segment_allocate(struct storage_table * table) {
+    uint64_t pointer = storage_allocate(table->storage, table->columns.amount + 1);
+
+    struct pager_page * page = storage_pin(table->storage, pointer);
+    storage_segment_header(page)->prev = table->last_page;
+    storage_segment_clear_zones(table, page);
+    pager_unpin(table->storage->pager, page, true);
+
+    if (table->last_page != 0) {
+        storage_write_at(table->storage, table->last_page + offsetof(struct storage_segment_header, next), &pointer, sizeof(pointer));
+    } else {
+        table->first_page = pointer;
+    }
+
+    table->last_page = pointer;
+    storage_table_write_pages(table);
+    return pointer;
+}
+
+// Appends the string to the string pages of the segment or to its own blob
+static struct storage_string_cell storage_segment_put_string(struct storage_table * table, struct pager_page * segment,
+    const char * str, uint16_t length) {
+
+    struct storage * storage = table->storage;
+    struct storage_segment_header * header = storage_segment_header(segment);
+    struct storage_string_cell string = { .offset = 0, .length = length, .blob = 0 };
+
+    if (length > PAGER_PAGE_SIZE - sizeof(struct storage_strings_header)) {
+        uint64_t blob = storage_allocate(storage, storage_blob_pages(length));
+        storage_write_at(storage, blob, str, length);
+
+        string.blob = blob / PAGER_PAGE_SIZE;
+        return string;
+    }
+
+    struct pager_page * page = header->strings != 0 ? storage_pin(storage, header->strings) : NULL;
+    struct storage_strings_header * strings = page ? (struct storage_strings_header *) page->data : NULL;
+
+    if (!page || strings->used + length > PAGER_PAGE_SIZE) {
+        if (page) {
+            pager_unpin(storage->pager, page, false);
+        }
+
+        uint64_t pointer = storage_allocate(storage, 1);
+        page = storage_pin(storage, pointer);
+        strings = (struct storage_strings_header *) page->data;
+
+        strings->next = header->strings;
+        strings->used = sizeof(*strings);
+        header->strings = pointer;
+    }
+
+    memcpy(page->data + strings->used, str, length);
+    string.offset = strings->used;
+    string.blob = header->strings / PAGER_PAGE_SIZE;
+    strings->used += length;
+
+    pager_unpin(storage->pager, page, true);
+    return string;
+}
+
+// Writes the value to the cell of the row in the pinned segment
+static void storage_segment_write_value(struct storage_table * table, uint64_t pointer, struct pager_page * segment,
+    uint16_t slot, uint16_t index, const struct storage_value * value) {
+
+    struct storage * storage = table->storage;
+    uint8_t * nulls = storage_segment_bitmap(segment, index);
+
+    // the string is encoded before the column page is pinned
+    uint64_t code = 0;
+    if (value && table->columns.columns[index].dictionary) {
+        code = storage_dictionary_encode(storage, table->dictionaries[index], value->value.str);
+    }
+
+    struct pager_page * page = storage_pin(storage, storage_segment_column(pointer, index));
+    uint8_t * cell = page->data + slot * sizeof(uint64_t);
+
+    struct storage_string_cell string;
+    memcpy(&string, cell, sizeof(string));
+
+    bool has_string = storage_column_has_strings(table, index) && !storage_bitmap_get(nulls, slot);
+
+    if (value && value->type == STORAGE_COLUMN_TYPE_STR) {
+        uint16_t length = (uint16_t) strlen(value->value.str);
+
+        // a string is overwritten in place if it is not longer than the old one
+        if (has_string && string.offset != 0 && length <= string.length) {
+            storage_write_at(storage, (uint64_t) string.blob * PAGER_PAGE_SIZE + string.offset, value->value.str, length);
+            string.length = length;
+            memcpy(cell, &string, sizeof(string));
+
+            pager_unpin(storage->pager, page, true);
+            return;
+        }
+    }
+
+    if (has_string && string.offset == 0) {
+        storage_free(storage, (uint64_t) string.blob * PAGER_PAGE_SIZE, storage_blob_pages(string.length));
+    }
+
+    storage_bitmap_set(nulls, slot, value == NULL);
+
+    if (value && value->type != STORAGE_COLUMN_TYPE_STR) {
+        storage_segment_widen_zone(table, segment, index, value);
+    }
+
+    if (value) {
+        switch (value->type) {
+            case STORAGE_COLUMN_TYPE_INT:
+                memcpy(cell, &value->value._int, sizeof(value->value._int));
+                break;
+
+            case STORAGE_COLUMN_TYPE_UINT:
+                memcpy(cell, &value->value.uint, sizeof(value->value.uint));
+                break;
+
+            case STORAGE_COLUMN_TYPE_NUM:
+                memcpy(cell, &value->value.num, sizeof(value->value.num));
+                break;
+
+            case STORAGE_COLUMN_TYPE_STR:
+                if (table->columns.columns[index].dictionary) {
+                    memcpy(cell, &code, sizeof(code));
+                    break;
+                }
+
+                string = storage_segment_put_string(table, segment, value->value.str, (uint16_t) strlen(value->value.str));
+                memcpy(cell, &string, sizeof(string));
+                break;
+        }
+    }
+
+    pager_unpin(storage->pager, page, true);
+}
+
+// Appends the row of the values to the last segment of the table, returns its position
+static uint64_t storage_segment_insert(struct storage_table * table, struct storage_value ** values) {
+    struct storage * storage = table->storage;
+    uint64_t pointer = table->last_page;
+    struct pager_page * page = pointer != 0 ? storage_pin(storage, pointer) : NULL;
+
+    if (!page || storage_segment_header(page)->rows == STORAGE_SEGMENT_ROWS) {
+        if (page) {
+            pager_unpin(storage->pager, page, false);
+        }
+
+        pointer = storage_segment_allocate(table);
+        page = storage_pin(storage, pointer);
+    }
+
+    struct storage_segment_header * header = storage_segment_header(page);
+    uint16_t slot = header->rows++;
+    ++header->live;
+
+    storage_bitmap_set(storage_segment_bitmap(page, UINT16_MAX), slot, true);
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        // cells of a new row have no strings to free
+        storage_bitmap_set(storage_segment_bitmap(page, i), slot, true);
+        storage_segment_write_value(table, pointer, page, slot, i, values[i]);
+    }
+
+    pager_unpin(storage->pager, page, true);
+    return pointer + slot;
+}
+
+// Allocates a string of the specified length in the arena or on the heap without it
+static char * storage_string_alloc(struct arena * arena, size_t length) {
+    char * str = arena ? arena_alloc(arena, length + 1) : malloc(sizeof(int8_t) * (length + 1));
+
+    str[length] = '\0';
+    return str;
+}
+
+static char * storage_string_copy(struct arena * arena, const char * source) {
+    size_t length = strlen(source);
+    char * str = storage_string_alloc(arena, length);
+
+    memcpy(str, source, length);
+    return str;
+}
+
+static bool storage_segment_read_value(struct storage_row * row, uint16_t index, struct storage_value * value, struct arena * arena) {
+    struct storage * storage = row->table->storage;
+    uint64_t pointer = STORAGE_ROW_PAGE(row->position);
+    uint16_t slot = STORAGE_ROW_SLOT(row->position);
+
+    struct pager_page * segment = storage_pin(storage, pointer);
+    bool null = storage_bitmap_get(storage_segment_bitmap(segment, index), slot);
+    pager_unpin(storage->pager, segment, false);
+
+    if (null) {
+        return false;
+    }
+
+    // only the page of the column is read
+    value->type = row->table->columns.columns[index].type;
+
+    struct pager_page * page = storage_pin(storage, storage_segment_column(pointer, index));
+    uint8_t * cell = page->data + slot * sizeof(uint64_t);
+
+    switch (value->type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            memcpy(&value->value._int, cell, sizeof(value->value._int));
+            break;
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            memcpy(&value->value.uint, cell, sizeof(value->value.uint));
+            break;
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            memcpy(&value->value.num, cell, sizeof(value->value.num));
+            break;
+
+        case STORAGE_COLUMN_TYPE_STR:
+        {
+            if (row->table->columns.columns[index].dictionary) {
+                uint64_t code;
+                memcpy(&code, cell, sizeof(code));
+
+                value->value.str = storage_string_copy(arena, row->table->dictionaries[index]->codes.strings[code]);
+                break;
+            }
+
+            struct storage_string_cell string;
+            memcpy(&string, cell, sizeof(string));
+
+            value->value.str = storage_string_alloc(arena, string.length);
+            pager_read(storage->pager, (uint64_t) string.blob * PAGER_PAGE_SIZE + string.offset, value->value.str, string.length);
+            break;
+        }
+    }
+
+    pager_unpin(storage->pager, page, false);
+    return true;
+}
+
+// Starts reading the column pages of the segment and the whole next segment in the background
+static void storage_segment_prefetch(struct storage_table * table, uint64_t pointer, uint64_t next) {
+    struct pager * pager = table->storage->pager;
+
+    pager_prefetch(pager, pointer / PAGER_PAGE_SIZE + 1, table->columns.amount);
+
+    if (next != 0) {
+        pager_prefetch(pager, next / PAGER_PAGE_SIZE, table->columns.amount + 1u);
+    }
+}
+
+// Positions the row at the first live row starting from the specified one, returns false at the end of table
+static bool storage_segment_seek(struct storage_row * row, uint64_t pointer, uint16_t slot) {
+    struct storage * storage = row->table->storage;
+
+    while (pointer) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_segment_header * header = storage_segment_header(page);
+        const uint8_t * live = storage_segment_bitmap(page, UINT16_MAX);
+
+        // the segment is skipped at once if its zone maps are out of the ranges
+        if (slot == 0 && !storage_segment_in_ranges(row, page)) {
+            slot = header->rows;
+        } else if (slot == 0) {
+            storage_segment_prefetch(row->table, pointer, header->next);
+        }
+
+        for (; slot < header->rows; ++slot) {
+            if (storage_bitmap_get(live, slot)) {
+                pager_unpin(storage->pager, page, false);
+
+                row->position = pointer + slot;
+                return true;
+            }
+        }
+
+        uint64_t next = header->next;
+        pager_unpin(storage->pager, page, false);
+
+        pointer = next;
+        slot = 0;
+    }
+
+    return false;
+}
+
+// Frees pages of the segment, its string pages and blobs of its live rows
+static void storage_segment_free(struct storage_table * table, uint64_t pointer) {
+    struct storage * storage = table->storage;
+    struct pager_page * segment = storage_pin(storage, pointer);
+    struct storage_segment_header * header = storage_segment_header(segment);
+    const uint8_t * live = storage_segment_bitmap(segment, UINT16_MAX);
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if (!storage_column_has_strings(table, i)) {
+            continue;
+        }
+
+        const uint8_t * nulls = storage_segment_bitmap(segment, i);
+        struct pager_page * page = storage_pin(storage, storage_segment_column(pointer, i));
+
+        for (uint16_t slot = 0; slot < header->rows; ++slot) {
+            struct storage_string_cell string;
+            memcpy(&string, page->data + slot * sizeof(uint64_t), sizeof(string));
+
+            if (storage_bitmap_get(live, slot) && !storage_bitmap_get(nulls, slot) && string.offset == 0) {
+                storage_free(storage, (uint64_t) string.blob * PAGER_PAGE_SIZE, storage_blob_pages(string.length));
+            }
+        }
+
+        pager_unpin(storage->pager, page, false);
+    }
+
+    for (uint64_t strings = header->strings; strings;) {
+        uint64_t next;
+        pager_read(storage->pager, strings, &next, sizeof(next));
+
+        storage_free(storage, strings, 1);
+        strings = next;
+    }
+
+    pager_unpin(storage->pager, segment, false);
+    storage_free(storage, pointer, table->columns.amount + 1);
+}
+
+// Marks the row as removed, the segment is unlinked and freed with its last row
+static void storage_segment_remove(struct storage_row * row) {
+    struct storage_table * table = row->table;
+    struct storage * storage = table->storage;
+    uint64_t pointer = STORAGE_ROW_PAGE(row->position);
+    uint16_t slot = STORAGE_ROW_SLOT(row->position);
+
+    struct pager_page * segment = storage_pin(storage, pointer);
+    struct storage_segment_header * header = storage_segment_header(segment);
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if (storage_column_has_strings(table, i)) {
+            storage_segment_write_value(table, pointer, segment, slot, i, NULL);
+        }
+    }
+
+    storage_bitmap_set(storage_segment_bitmap(segment, UINT16_MAX), slot, false);
+    --header->live;
+
+    if (header->live > 0) {
+        pager_unpin(storage->pager, segment, true);
+        return;
+    }
+
+    // the freed segment keeps its next pointer for cursors standing on it
+    if (header->prev != 0) {
+        storage_write_at(storage, header->prev + offsetof(struct storage_segment_header, next), &header->next, sizeof(header->next));
+    } else {
+        table->first_page = header->next;
+    }
+
+    if (header->next != 0) {
+        storage_write_at(storage, header->next + offsetof(struct storage_segment_header, prev), &header->prev, sizeof(header->prev));
+    } else {
+        table->last_page = header->prev;
+    }
+
+    storage_table_write_pages(table);
+    pager_unpin(storage->pager, segment, true);
+    storage_segment_free(table, pointer);
+}
+
+// Copies live rows of the table to new segments and frees old ones
+static void storage_segments_vacuum(struct storage_table * table) {
+    uint64_t old_segment = table->first_page;
+    struct storage_value ** values = malloc(sizeof(*values) * table->columns.amount);
+    struct storage_row row = { .table = table };
+
+    table->first_page = 0;
+    table->last_page = 0;
+
+    for (bool found = storage_segment_seek(&row, old_segment, 0); found;
+        found = storage_segment_seek(&row, STORAGE_ROW_PAGE(row.position), STORAGE_ROW_SLOT(row.position) + 1)) {
+
+        for (uint16_t i = 0; i < table->columns.amount; ++i) {
+            values[i] = storage_row_get_value(&row, i);
+        }
+
+        storage_segment_insert(table, values);
+
+        for (uint16_t i = 0; i < table->columns.amount; ++i) {
+            storage_value_delete(values[i]);
+        }
+    }
+
+    free(values);
+    storage_table_write_pages(table);
+
+    while (old_segment) {
+        uint64_t next;
+        pager_read(table->storage->pager, old_segment, &next, sizeof(next));
+
+        storage_segment_free(table, old_segment);
+        old_segment = next;
+    }
+}
+
+// Frees all data pages of the table with blobs of their rows, returns the amount of removed rows
+static uint64_t storage_table_free_pages(struct storage_table * table) {
+    uint64_t amount = 0;
+
+    if (table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        for (uint64_t pointer = table->first_page; pointer;) {
+            struct storage_segment_header header;
+            pager_read(table->storage->pager, pointer, &header, sizeof(header));
+
+            storage_segment_free(table, pointer);
+            amount += header.live;
+            pointer = header.next;
+        }
+
+        return amount;
+    }
+
+    for (uint64_t pointer = table->first_page; pointer;) {
+        struct pager_page * page = storage_pin(table->storage, pointer);
+        struct storage_page_header * header = storage_page_header(page);
+
+        for (uint16_t slot = 0; slot < header->slots; ++slot) {
+            if (storage_page_slots(page)[slot].offset != 0) {
+                storage_record_free_blobs(table, page->data + storage_page_slots(page)[slot].offset, UINT16_MAX);
+                ++amount;
+            }
+        }
+
+        uint64_t next = header->next;
+        pager_unpin(table->storage->pager, page, false);
+
+        storage_free(table->storage, pointer, 1);
+        pointer = next;
+    }
+
+    return amount;
+}
+
+void storage_table_remove(struct storage_table * table) {
+    struct storage * storage = table->storage;
+    uint64_t pointer = STORAGE_HEADER_FIRST_TABLE;
+
+    // the previous table in the chain is looked up in the catalog instead of the file
+    for (size_t i = 0; i < storage->tables.size && pointer == STORAGE_HEADER_FIRST_TABLE; ++i) {
+        for (struct storage_table * entry = storage->tables.buckets[i]; entry; entry = entry->next_in_bucket) {
+            if (entry->next == table->position) {
+                entry->next = table->next;
+                pointer = entry->position;
+                break;
+            }
+        }
+    }
+
+    if (pointer == STORAGE_HEADER_FIRST_TABLE) {
+        storage->first_table = table->next;
+    }
+
+    storage_write_at(storage, pointer, &table->next, sizeof(table->next));
+
+    storage_table_free_pages(table);
+    storage_free(storage, table->position, 1);
+    storage_free(storage, table->stats.position, storage_stats_pages(table));
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if (table->dictionaries[i]) {
+            storage_dictionary_destroy(storage, table->dictionaries[i]);
+        }
+    }
+
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        storage_index_destroy(table->indexes.indexes[i]);
+        storage_free(storage, table->indexes.indexes[i]->position, 1);
+    }
+
+    storage_catalog_remove(storage, table);
+    storage_table_delete(table);
+}
+
+uint64_t storage_table_truncate(struct storage_table * table) {
+    uint64_t amount = storage_table_free_pages(table);
+
+    table->first_page = 0;
+    table->last_page = 0;
+    table->free_page = 0;
+    storage_table_write_pages(table);
+    storage_stats_reset(table);
+
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        storage_index_clear(table->indexes.indexes[i]);
+    }
+
+    return amount;
+}
+
+static bool storage_index_exists(struct storage * storage, const char * name) {
+    for (size_t i = 0; i < storage->tables.size; ++i) {
+        for (struct storage_table * table = storage->tables.buckets[i]; table; table = table->next_in_bucket) {
+            for (uint16_t j = 0; j < table->indexes.amount; ++j) {
+                if (strcmp(table->indexes.indexes[j]->name, name) == 0) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+struct storage_index * storage_table_add_index(struct storage_table * table, const char * name, uint16_t column, enum storage_index_type type) {
+    struct storage * storage = table->storage;
+
+    if (column >= table->columns.amount || storage_index_exists(storage, name)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (2 * sizeof(uint64_t) + sizeof(uint16_t) + 2 * sizeof(uint8_t) + sizeof(uint16_t) + strlen(name) > PAGER_PAGE_SIZE) {
+        errno = E2BIG;
+        return NULL;
+    }
+
+    struct storage_index * index = malloc(sizeof(*index));
+    index->table = table;
+    index->next = table->first_index;
+    index->name = strdup(name);
+    index->column = column;
+    index->type = type;
+    index->depth = 0;
+    index->position = storage_allocate(storage, 1);
+    storage_index_init(index);
+
+    struct pager_page * page = storage_pin(storage, index->position);
+    size_t offset = 0;
+    uint8_t type_byte = type;
+
+    storage_put(page->data, &offset, &index->next, sizeof(index->next));
+    storage_put(page->data, &offset, &index->root, sizeof(index->root));
+    storage_put(page->data, &offset, &index->column, sizeof(index->column));
+    storage_put(page->data, &offset, &type_byte, sizeof(type_byte));
+    storage_put(page->data, &offset, &index->depth, sizeof(index->depth));
+    storage_put_string(page->data, &offset, index->name);
+    pager_unpin(storage->pager, page, true);
+
+    table->first_index = index->position;
+    storage_write_at(storage, table->position + STORAGE_TABLE_HEADER_FIRST_INDEX, &table->first_index, sizeof(table->first_index));
+
+    table->indexes.indexes = realloc(table->indexes.indexes, sizeof(*table->indexes.indexes) * (table->indexes.amount + 1));
+    table->indexes.indexes[table->indexes.amount++] = index;
+
+    storage_index_build(index);
+    return index;
+}
+
+struct storage_index * storage_table_get_index(struct storage_table * table, uint16_t column, enum storage_index_type type) {
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        if (table->indexes.indexes[i]->column == column && table->indexes.indexes[i]->type == type) {
+            return table->indexes.indexes[i];
+        }
+    }
+
+    return NULL;
+}
+
+uint64_t * storage_index_find(struct storage_index * index, struct storage_value * from, struct storage_value * to, size_t * amount) {
+    enum storage_column_type type = index->table->columns.columns[index->column].type;
+
+    if ((from && from->type != type) || (to && to->type != type)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (index->type == STORAGE_INDEX_TYPE_HASH) {
+        // hash indexes find only equal values
+        if (!from || !to || storage_hash_value(index, from) != storage_hash_value(index, to)) {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        return storage_hash_find(index, storage_hash_value(index, from), amount);
+    }
+
+    struct storage * storage = index->table->storage;
+    size_t entry_length = storage_index_entry_length(index);
+
+    uint8_t low[STORAGE_INDEX_STRING_KEY_LENGTH + sizeof(uint64_t)] = { 0 };
+    uint8_t high[STORAGE_INDEX_STRING_KEY_LENGTH + sizeof(uint64_t)];
+
+    if (from) {
+        storage_index_encode(index, from, 0, low);
+    }
+
+    if (to) {
+        storage_index_encode(index, to, UINT64_MAX, high);
+    }
+
+    size_t capacity = 16;
+    uint64_t * positions = malloc(sizeof(*positions) * capacity);
+    *amount = 0;
+
+    uint64_t pointer = storage_index_find_leaf(index, low, NULL, NULL);
+    struct pager_page * page = storage_pin(storage, pointer);
+    uint16_t at = storage_index_node_search(index, page, low, true);
+
+    while (true) {
+        struct storage_index_node * node = storage_index_node(page);
+
+        for (; at < node->amount; ++at) {
+            uint8_t * entry = storage_index_item(index, page, at);
+
+            if (to && memcmp(entry, high, entry_length) > 0) {
+                pager_unpin(storage->pager, page, false);
+                return positions;
+            }
+
+            if (*amount == capacity) {
+                capacity *= 2;
+                positions = realloc(positions, sizeof(*positions) * capacity);
+            }
+
+            positions[(*amount)++] = storage_index_get_u64(entry + storage_index_key_length(index));
+        }
+
+        pointer = node->next;
+        pager_unpin(storage->pager, page, false);
+
+        if (pointer == 0) {
+            return positions;
+        }
+
+        page = storage_pin(storage, pointer);
+        at = 0;
+    }
+}
+
+// Counts data pages of the table and bytes used by their live records and slots
+static void storage_table_usage(struct storage_table * table, uint64_t * pages, uint64_t * used) {
+    *pages = 0;
+    *used = 0;
+
+    // a segment counts as one page filled by its live rows
+    if (table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        for (uint64_t pointer = table->first_page; pointer;) {
+            struct storage_segment_header header;
+            pager_read(table->storage->pager, pointer, &header, sizeof(header));
+
+            ++*pages;
+            *used += (uint64_t) header.live * PAGER_PAGE_SIZE / STORAGE_SEGMENT_ROWS;
+            pointer = header.next;
+        }
+
+        return;
+    }
+
+    for (uint64_t pointer = table->first_page; pointer;) {
+        struct pager_page * page = storage_pin(table->storage, pointer);
+        struct storage_page_header * header = storage_page_header(page);
+
+        ++*pages;
+        *used += PAGER_PAGE_SIZE - storage_page_free_space(header) - header->dead;
+
+        pointer = header->next;
+        pager_unpin(table->storage->pager, page, false);
+    }
+}
+
+// Positions of all rows have changed, so indexes are built again, stats are counted again without removed values
+static void storage_table_rebuild_indexes(struct storage_table * table) {
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        storage_index_clear(table->indexes.indexes[i]);
+        storage_index_build(table->indexes.indexes[i]);
+    }
+
+    storage_stats_reset(table);
+
+    for (struct storage_row * row = storage_table_get_first_row(table); row; row = storage_row_next(row)) {
+        ++table->stats.rows;
+
+        for (uint16_t i = 0; i < table->columns.amount; ++i) {
+            struct storage_value * value = storage_row_get_value(row, i);
+            storage_stats_add(table, i, value);
+            storage_value_delete(value);
+        }
+    }
+}
+
+void storage_table_vacuum(struct storage_table * table) {
+    struct storage * storage = table->storage;
+
+    uint64_t pages, used;
+    storage_table_usage(table, &pages, &used);
+
+    if (pages == 0) {
+        return;
+    }
+
+    if (table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        storage_segments_vacuum(table);
+        storage_table_rebuild_indexes(table);
+        return;
+    }
+
+    // live rows are copied in scan order to a run of pages that is allocated at once
+    uint64_t run_amount = (used + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE;
+    uint64_t run = storage_allocate(storage, run_amount);
+    uint64_t run_used = 0;
+
+    uint64_t first_page = 0, last_page = 0;
+    struct pager_page * target = NULL;
+
+    for (uint64_t pointer = table->first_page; pointer;) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_page_header * header = storage_page_header(page);
+
+        for (uint16_t slot = 0; slot < header->slots; ++slot) {
+            struct storage_slot record = storage_page_slots(page)[slot];
+
+            if (record.offset == 0) {
+                continue;
+            }
+
+            uint8_t buffer[PAGER_PAGE_SIZE];
+            uint16_t length = STORAGE_ALIGN(storage_record_pack(table, page->data + record.offset, buffer));
+
+            int target_slot = target ? storage_page_insert(target, length) : -1;
+            if (target_slot < 0) {
+                uint64_t target_pointer;
+
+                if (run_used < run_amount) {
+                    target_pointer = run + run_used++ * PAGER_PAGE_SIZE;
+                } else {
+                    target_pointer = storage_allocate(storage, 1);
+                }
+
+                struct pager_page * next_target = storage_pin(storage, target_pointer);
+                struct storage_page_header * next_header = storage_page_header(next_target);
+                memset(next_header, 0, sizeof(*next_header));
+                next_header->heap = PAGER_PAGE_SIZE;
+                next_header->prev = last_page;
+
+                if (target) {
+                    storage_page_header(target)->next = target_pointer;
+                    pager_unpin(storage->pager, target, true);
+                } else {
+                    first_page = target_pointer;
+                }
+
+                target = next_target;
+                last_page = target_pointer;
+                target_slot = storage_page_insert(target, length);
+            }
+
+            memcpy(target->data + storage_page_slots(target)[target_slot].offset, buffer, length);
+        }
+
+        pointer = header->next;
+        pager_unpin(storage->pager, page, false);
+    }
+
+    if (target) {
+        pager_unpin(storage->pager, target, true);
+    }
+
+    if (run_used < run_amount) {
+        storage_free(storage, run + run_used * PAGER_PAGE_SIZE, run_amount - run_used);
+    }
+
+    uint64_t old_page = table->first_page;
+
+    table->first_page = first_page;
+    table->last_page = last_page;
+    table->free_page = 0;
+    storage_table_write_pages(table);
+
+    while (old_page) {
+        uint64_t next;
+        pager_read(storage->pager, old_page, &next, sizeof(next));
+
+        storage_free(storage, old_page, 1);
+        old_page = next;
+    }
+
+    storage_table_rebuild_indexes(table);
+}
+
+void storage_vacuum(struct storage * storage) {
+    for (size_t i = 0; i < storage->tables.size; ++i) {
+        for (struct storage_table * table = storage->tables.buckets[i]; table; table = table->next_in_bucket) {
+            // tables that use less than a half of their data pages are vacuumed
+            uint64_t pages, used;
+            storage_table_usage(table, &pages, &used);
+
+            if (pages > 1 && used * 2 < pages * PAGER_PAGE_SIZE) {
+                storage_table_vacuum(table);
+            }
+        }
+    }
+}
+
+// Starts reading the next data page and blobs of the records of the page in the background
+static void storage_page_prefetch(struct storage_table * table, struct pager_page * page) {
+    struct storage_page_header * header = storage_page_header(page);
+    struct storage_slot * slots = storage_page_slots(page);
+
+    if (header->next != 0) {
+        pager_prefetch(table->storage->pager, header->next / PAGER_PAGE_SIZE, 1);
+    }
+
+    for (uint16_t slot = 0; slot < header->slots; ++slot) {
+        if (slots[slot].offset != 0) {
+            storage_record_prefetch_blobs(table, page->data + slots[slot].offset);
+        }
+    }
+}
+
+// Positions the row at the first used slot starting from the specified one, returns false at the end of table
+static bool storage_row_seek(struct storage_row * row, uint64_t pointer, uint16_t slot) {
+    struct storage * storage = row->table->storage;
+
+    if (row->table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        return storage_segment_seek(row, pointer, slot);
+    }
+
+    while (pointer) {
+        struct pager_page * page = storage_pin(storage, pointer);
+        struct storage_page_header * header = storage_page_header(page);
+        struct storage_slot * slots = storage_page_slots(page);
+
+        if (slot == 0) {
+            storage_page_prefetch(row->table, page);
+        }
+
+        for (; slot < header->slots; ++slot) {
+            if (slots[slot].offset != 0) {
+                pager_unpin(storage->pager, page, false);
+
+                row->position = pointer + slot;
+                return true;
+            }
+        }
+
+        uint64_t next = header->next;
+        pager_unpin(storage->pager, page, false);
+
+        pointer = next;
+        slot = 0;
+    }
+
+    return false;
+}
+
+struct storage_row * storage_table_get_first_row(struct storage_table * table) {
+    return storage_table_get_first_row_in(table, NULL, 0);
+}
+
+struct storage_row * storage_table_get_first_row_in(struct storage_table * table, const struct storage_range * ranges, size_t amount) {
+    struct storage_row * row = malloc(sizeof(*row));
+    row->table = table;
+    row->ranges.amount = amount;
+    row->ranges.ranges = ranges;
+
+    if (!storage_row_seek(row, table->first_page, 0)) {
+        free(row);
+        return NULL;
+    }
+
+    return row;
+}
+
+// Places the record into a data page of the table, returns its position
+static uint64_t storage_table_place_record(struct storage_table * table, const uint8_t * record, uint16_t length) {
+    struct storage * storage = table->storage;
+
+    if (table->last_page == 0) {
+        table->first_page = table->last_page = storage_allocate_data_page(storage);
+        storage_table_write_pages(table);
+    }
+
+    struct pager_page * page;
+    int slot = -1;
+
+    // pages with free space left by removed rows are filled first
+    while (table->free_page != 0) {
+        page = storage_pin(storage, table->free_page);
+        slot = storage_page_insert(page, length);
+
+        if (slot >= 0) {
+            break;
+        }
+
+        struct storage_page_header * header = storage_page_header(page);
+        header->flags &= ~STORAGE_PAGE_IN_FREE_LIST;
+        table->free_page = header->next_free;
+        header->next_free = 0;
+
+        pager_unpin(storage->pager, page, true);
+        storage_table_write_pages(table);
+
+        if (table->free_page != 0) {
+            uint64_t prev_free = 0;
+            storage_write_at(storage, table->free_page + offsetof(struct storage_page_header, prev_free), &prev_free, sizeof(prev_free));
+        }
+    }
+
+    uint64_t pointer = table->free_page;
+    if (slot < 0) {
+        pointer = table->last_page;
+        page = storage_pin(storage, pointer);
+        slot = storage_page_insert(page, length);
+    }
+
+    if (slot < 0) {
+        pointer = storage_allocate_data_page(storage);
+
+        storage_page_header(page)->next = pointer;
+        pager_unpin(storage->pager, page, true);
+
+        page = storage_pin(storage, pointer);
+        storage_page_header(page)->prev = table->last_page;
+        slot = storage_page_insert(page, length);
+
+        table->last_page = pointer;
+        storage_table_write_pages(table);
+    }
+
+    memcpy(page->data + storage_page_slots(page)[slot].offset, record, length);
+    pager_unpin(storage->pager, page, true);
+
+    return pointer + slot;
+}
+
+// Builds the whole record of the values in the buffer, returns its length
+static uint16_t storage_record_build(struct storage_table * table, struct storage_value ** values, uint8_t * buffer) {
+    size_t record_length = storage_record_length(table);
+    size_t max_length = PAGER_PAGE_SIZE - sizeof(struct storage_page_header) - sizeof(struct storage_slot);
+
+    memset(buffer, 0, record_length);
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        struct storage_value * value = values[i];
+        uint8_t * cell = buffer + i * sizeof(uint64_t);
+
+        if (!value) {
+            storage_record_set_null(table, buffer, i, true);
+            continue;
+        }
+
+        switch (value->type) {
+            case STORAGE_COLUMN_TYPE_INT:
+                memcpy(cell, &value->value._int, sizeof(value->value._int));
+                break;
+
+            case STORAGE_COLUMN_TYPE_UINT:
+                memcpy(cell, &value->value.uint, sizeof(value->value.uint));
+                break;
+
+            case STORAGE_COLUMN_TYPE_NUM:
+                memcpy(cell, &value->value.num, sizeof(value->value.num));
+                break;
+
+            case STORAGE_COLUMN_TYPE_STR:
+            {
+                if (table->columns.columns[i].dictionary) {
+                    uint64_t code = storage_dictionary_encode(table->storage, table->dictionaries[i], value->value.str);
+                    memcpy(cell, &code, sizeof(code));
+                    break;
+                }
+
+                uint16_t length = (uint16_t) strlen(value->value.str);
+                struct storage_string_cell string = { .offset = record_length, .length = length, .blob = 0 };
+
+                if (STORAGE_ALIGN(record_length + length) <= max_length) {
+                    memcpy(buffer + record_length, value->value.str, length);
+                    record_length += length;
+                } else {
+                    // the string doesn't fit the page, so it is placed to its own pages
+                    uint64_t blob = storage_allocate(table->storage, storage_blob_pages(length));
+                    storage_write_at(table->storage, blob, value->value.str, length);
+
+                    string.offset = 0;
+                    string.blob = blob / PAGER_PAGE_SIZE;
+                }
+
+                memcpy(cell, &string, sizeof(string));
+                break;
+            }
+        }
+    }
+
+    return STORAGE_ALIGN(record_length);
+}
+
+bool storage_table_check_row(struct storage_table * table, struct storage_value ** values) {
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        if (!values[i]) {
+            continue;
+        }
+
+        if (values[i]->type != table->columns.columns[i].type
+            || (values[i]->type == STORAGE_COLUMN_TYPE_STR && strlen(values[i]->value.str) > UINT16_MAX)) {
+
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct storage_row * storage_table_add_row(struct storage_table * table, struct storage_value ** values) {
+    if (!storage_table_check_row(table, values)) {
+        return NULL;
+    }
+
+    struct storage_row * row = malloc(sizeof(*row));
+    row->table = table;
+    row->ranges.amount = 0;
+    row->ranges.ranges = NULL;
+
+    if (table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        row->position = storage_segment_insert(table, values);
+    } else {
+        // the row is written to its page at once with all values
+        uint8_t buffer[PAGER_PAGE_SIZE];
+        uint16_t length = storage_record_build(table, values, buffer);
+
+        row->position = storage_table_place_record(table, buffer, length);
+    }
+
+    ++table->stats.rows;
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        storage_table_index_value(table, i, row->position, values[i], true);
+        storage_stats_add(table, i, values[i]);
+    }
+
+    return row;
+}
+
+void storage_row_delete(struct storage_row * row) {
+    free(row);
+}
+
+struct storage_row * storage_row_next(struct storage_row * row) {
+    if (!storage_row_seek(row, STORAGE_ROW_PAGE(row->position), STORAGE_ROW_SLOT(row->position) + 1)) {
+        free(row);
+        return NULL;
+    }
+
+    return row;
+}
+
+// Unlinks the empty page from the lists of the table, keeps its own next pointer for cursors standing on it
+static void storage_table_unlink_page(struct storage_table * table, struct storage_page_header * header) {
+    struct storage * storage = table->storage;
+
+    if (header->prev != 0) {
+        storage_write_at(storage, header->prev + offsetof(struct storage_page_header, next), &header->next, sizeof(header->next));
+    } else {
+        table->first_page = header->next;
+    }
+
+    if (header->next != 0) {
+        storage_write_at(storage, header->next + offsetof(struct storage_page_header, prev), &header->prev, sizeof(header->prev));
+    } else {
+        table->last_page = header->prev;
+    }
+
+    if (header->flags & STORAGE_PAGE_IN_FREE_LIST) {
+        if (header->prev_free != 0) {
+            storage_write_at(storage, header->prev_free + offsetof(struct storage_page_header, next_free), &header->next_free, sizeof(header->next_free));
+        } else {
+            table->free_page = header->next_free;
+        }
+
+        if (header->next_free != 0) {
+            storage_write_at(storage, header->next_free + offsetof(struct storage_page_header, prev_free), &header->prev_free, sizeof(header->prev_free));
+        }
+    }
+
+    storage_table_write_pages(table);
+}
+
+static bool storage_row_is_null(struct storage_row * row, uint16_t index) {
+    struct storage * storage = row->table->storage;
+    struct pager_page * page = storage_pin(storage, STORAGE_ROW_PAGE(row->position));
+    uint16_t slot = STORAGE_ROW_SLOT(row->position);
+    bool null;
+
+    if (row->table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        null = storage_bitmap_get(storage_segment_bitmap(page, index), slot);
+    } else {
+        null = storage_record_is_null(row->table, page->data + storage_page_slots(page)[slot].offset, index);
+    }
+
+    pager_unpin(storage->pager, page, false);
+    return null;
+}
+
+void storage_row_remove(struct storage_row * row) {
+    struct storage_table * table = row->table;
+
+    for (uint16_t i = 0; i < table->indexes.amount; ++i) {
+        struct storage_value * value = storage_row_get_value(row, table->indexes.indexes[i]->column);
+
+        storage_table_index_value(table, table->indexes.indexes[i]->column, row->position, value, false);
+        storage_value_delete(value);
+    }
+
+    --table->stats.rows;
+
+    for (uint16_t i = 0; i < table->columns.amount; ++i) {
+        storage_stats_remove(table, i, storage_row_is_null(row, i));
+    }
+
+    if (table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        storage_segment_remove(row);
+        return;
+    }
+
+    struct pager_page * page = storage_pin(table->storage, STORAGE_ROW_PAGE(row->position));
+    uint16_t slot = STORAGE_ROW_SLOT(row->position);
+
+    storage_record_free_blobs(table, page->data + storage_page_slots(page)[slot].offset, UINT16_MAX);
+    storage_page_remove(page, slot);
+
+    struct storage_page_header * header = storage_page_header(page);
+    if (header->slots == 0) {
+        storage_table_unlink_page(table, header);
+        pager_unpin(table->storage->pager, page, true);
+
+        storage_free(table->storage, STORAGE_ROW_PAGE(row->position), 1);
+        return;
+    }
+
+    if (!(header->flags & STORAGE_PAGE_IN_FREE_LIST) && storage_page_free_space(header) + header->dead >= STORAGE_FREE_PAGE_THRESHOLD) {
+        header->flags |= STORAGE_PAGE_IN_FREE_LIST;
+        header->prev_free = 0;
+        header->next_free = table->free_page;
+
+        if (table->free_page != 0) {
+            uint64_t prev_free = STORAGE_ROW_PAGE(row->position);
+            storage_write_at(table->storage, table->free_page + offsetof(struct storage_page_header, prev_free), &prev_free, sizeof(prev_free));
+        }
+
+        table->free_page = STORAGE_ROW_PAGE(row->position);
+        storage_table_write_pages(table);
+    }
+
+    pager_unpin(table->storage->pager, page, true);
+}
+
+bool storage_row_read_value(struct storage_row * row, uint16_t index, struct storage_value * value) {
+    return storage_row_read_value_in_arena(row, index, value, NULL);
+}
+
+bool storage_row_read_value_in_arena(struct storage_row * row, uint16_t index, struct storage_value * value, struct arena * arena) {
+    if (index >= row->table->columns.amount) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (row->table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        return storage_segment_read_value(row, index, value, arena);
+    }
+
+    struct storage * storage = row->table->storage;
+    struct pager_page * page = storage_pin(storage, STORAGE_ROW_PAGE(row->position));
+    uint8_t * record = page->data + storage_page_slots(page)[STORAGE_ROW_SLOT(row->position)].offset;
+
+    if (storage_record_is_null(row->table, record, index)) {
+        pager_unpin(storage->pager, page, false);
+        return false;
+    }
+
+    value->type = row->table->columns.columns[index].type;
+
+    uint8_t * cell = record + index * sizeof(uint64_t);
+    switch (value->type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            memcpy(&value->value._int, cell, sizeof(value->value._int));
+            break;
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            memcpy(&value->value.uint, cell, sizeof(value->value.uint));
+            break;
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            memcpy(&value->value.num, cell, sizeof(value->value.num));
+            break;
+
+        case STORAGE_COLUMN_TYPE_STR:
+        {
+            if (row->table->columns.columns[index].dictionary) {
+                uint64_t code;
+                memcpy(&code, cell, sizeof(code));
+
+                value->value.str = storage_string_copy(arena, row->table->dictionaries[index]->codes.strings[code]);
+                break;
+            }
+
+            struct storage_string_cell string;
+            memcpy(&string, cell, sizeof(string));
+
+            value->value.str = storage_string_alloc(arena, string.length);
+
+            if (string.offset != 0) {
+                memcpy(value->value.str, record + string.offset, string.length);
+            } else {
+                pager_read(storage->pager, (uint64_t) string.blob * PAGER_PAGE_SIZE, value->value.str, string.length);
+            }
+
+            break;
+        }
+    }
+
+    pager_unpin(storage->pager, page, false);
+    return true;
+}
+
+struct storage_value * storage_row_get_value(struct storage_row * row, uint16_t index) {
+    struct storage_value value;
+    if (!storage_row_read_value(row, index, &value)) {
+        return NULL;
+    }
+
+    struct storage_value * result = malloc(sizeof(*result));
+    *result = value;
+    return result;
+}
+
+bool storage_row_get_code(struct storage_row * row, uint16_t index, uint64_t * code) {
+    if (index >= row->table->columns.amount || !row->table->columns.columns[index].dictionary) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct storage * storage = row->table->storage;
+    uint64_t pointer = STORAGE_ROW_PAGE(row->position);
+    uint16_t slot = STORAGE_ROW_SLOT(row->position);
+    struct pager_page * page = storage_pin(storage, pointer);
+    bool null;
+
+    if (row->table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        null = storage_bitmap_get(storage_segment_bitmap(page, index), slot);
+        pager_unpin(storage->pager, page, false);
+
+        if (null) {
+            return false;
+        }
+
+        page = storage_pin(storage, storage_segment_column(pointer, index));
+        memcpy(code, page->data + slot * sizeof(uint64_t), sizeof(*code));
+    } else {
+        uint8_t * record = page->data + storage_page_slots(page)[slot].offset;
+
+        null = storage_record_is_null(row->table, record, index);
+        memcpy(code, record + index * sizeof(uint64_t), sizeof(*code));
+    }
+
+    pager_unpin(storage->pager, page, false);
+    return !null;
+}
+
+bool storage_table_find_code(struct storage_table * table, uint16_t index, const char * str, uint64_t * code) {
+    if (index >= table->columns.amount || !table->columns.columns[index].dictionary) {
+        errno = EINVAL;
+        return false;
+    }
+
+    return storage_dictionary_find(table->dictionaries[index], str, code);
+}
+
+// Rebuilds the record with the new string in the specified cell, returns false if it doesn't fit the page
+static bool storage_row_set_string(struct storage_row * row, struct pager_page * page, uint16_t index, const char * str, uint16_t length) {
+    struct storage_table * table = row->table;
+    uint16_t slot = STORAGE_ROW_SLOT(row->position);
+
+    uint8_t buffer[PAGER_PAGE_SIZE];
+    size_t record_length = storage_record_pack(table, page->data + storage_page_slots(page)[slot].offset, buffer);
+
+    if (record_length + length > PAGER_PAGE_SIZE) {
+        return false;
+    }
+
+    struct storage_string_cell string = { .offset = record_length, .length = length, .blob = 0 };
+    memcpy(buffer + record_length, str, length);
+    memcpy(buffer + index * sizeof(uint64_t), &string, sizeof(string));
+    storage_record_set_null(table, buffer, index, false);
+    record_length = STORAGE_ALIGN(record_length + length);
+
+    if (!storage_page_resize(page, slot, record_length)) {
+        return false;
+    }
+
+    memcpy(page->data + storage_page_slots(page)[slot].offset, buffer, record_length);
+    return true;
+}
+
+// Writes the value to the cell of the row, returns false if the value is not written
+static bool storage_row_write_value(struct storage_row * row, uint16_t index, struct storage_value * value) {
+    struct storage * storage = row->table->storage;
+
+    if (value && value->type == STORAGE_COLUMN_TYPE_STR && strlen(value->value.str) > UINT16_MAX) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (row->table->format == STORAGE_TABLE_FORMAT_COLUMNS) {
+        struct pager_page * segment = storage_pin(storage, STORAGE_ROW_PAGE(row->position));
+        storage_segment_write_value(row->table, STORAGE_ROW_PAGE(row->position), segment, STORAGE_ROW_SLOT(row->position), index, value);
+        pager_unpin(storage->pager, segment, true);
+        return true;
+    }
+
+    // the string is encoded before the page of the row is pinned
+    uint64_t code = 0;
+    if (value && row->table->columns.columns[index].dictionary) {
+        code = storage_dictionary_encode(storage, row->table->dictionaries[index], value->value.str);
+    }
+
+    struct pager_page * page = storage_pin(storage, STORAGE_ROW_PAGE(row->position));
+    uint8_t * record = page->data + storage_page_slots(page)[STORAGE_ROW_SLOT(row->position)].offset;
+    uint8_t * cell = record + index * sizeof(uint64_t);
+
+    if (!value) {
+        storage_record_free_blobs(row->table, record, index);
+        storage_record_set_null(row->table, record, index, true);
+        pager_unpin(storage->pager, page, true);
+        return true;
+    }
+
+    switch (value->type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            memcpy(cell, &value->value._int, sizeof(value->value._int));
+            break;
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            memcpy(cell, &value->value.uint, sizeof(value->value.uint));
+            break;
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            memcpy(cell, &value->value.num, sizeof(value->value.num));
+            break;
+
+        case STORAGE_COLUMN_TYPE_STR:
+        {
+            size_t length = strlen(value->value.str);
+
+            if (row->table->columns.columns[index].dictionary) {
+                memcpy(cell, &code, sizeof(code));
+                break;
+            }
+
+            struct storage_string_cell string;
+            memcpy(&string, cell, sizeof(string));
+
+            if (!storage_record_is_null(row->table, record, index) && string.offset != 0 && length <= string.length) {
+                memcpy(record + string.offset, value->value.str, length);
+                string.length = length;
+                memcpy(cell, &string, sizeof(string));
+                break;
+            }
+
+            storage_record_free_blobs(row->table, record, index);
+            storage_record_set_null(row->table, record, index, true);
+
+            if (storage_row_set_string(row, page, index, value->value.str, length)) {
+                pager_unpin(storage->pager, page, true);
+                return true;
+            }
+
+            // the string doesn't fit the page, so it is placed to its own pages
+            uint64_t blob = storage_allocate(storage, storage_blob_pages(length));
+            storage_write_at(storage, blob, value->value.str, length);
+
+            string.offset = 0;
+            string.length = length;
+            string.blob = blob / PAGER_PAGE_SIZE;
+            memcpy(cell, &string, sizeof(string));
+            break;
+        }
+    }
+
+    storage_record_set_null(row->table, record, index, false);
+    pager_unpin(storage->pager, page, true);
+    return true;
+}
+
+// Changes the value of the row in place
+static void storage_row_change_value(struct storage_row * row, uint16_t index, struct storage_value * value) {
+    if (!storage_table_is_indexed(row->table, index)) {
+        bool null = storage_row_is_null(row, index);
+
+        if (storage_row_write_value(row, index, value)) {
+            storage_stats_remove(row->table, index, null);
+            storage_stats_add(row->table, index, value);
+        }
+
+        return;
+    }
+
+    struct storage_value * old = storage_row_get_value(row, index);
+    storage_table_index_value(row->table, index, row->position, old, false);
+
+    bool written = storage_row_write_value(row, index, value);
+    storage_table_index_value(row->table, index, row->position, written ? value : old, true);
+
+    if (written) {
+        storage_stats_remove(row->table, index, old == NULL);
+        storage_stats_add(row->table, index, value);
+    }
+
+    storage_value_delete(old);
+}
+
+void storage_row_set_value(struct storage_row * row, uint16_t index, struct storage_value * value) {
+    unsigned int indexes[] = { index };
+    storage_row_set_values(row, 1, indexes, &value);
+}
+
+void storage_row_set_values(struct storage_row * row, unsigned int amount, const unsigned int * indexes, struct storage_value ** values) {
+    struct storage_table * table = row->table;
+
+    for (unsigned int i = 0; i < amount; ++i) {
+        if (indexes[i] >= table->columns.amount || (values[i] && table->columns.columns[indexes[i]].type != values[i]->type)) {
+            errno = EINVAL;
+            return;
+        }
+    }
+
+    for (unsigned int i = 0; i < amount; ++i) {
+        storage_row_change_value(row, (uint16_t) indexes[i], values[i]);
+    }
+}
+
+void storage_value_destroy(struct storage_value value) {
+    switch (value.type) {
+        case STORAGE_COLUMN_TYPE_STR:
+            free(value.value.str);
+
+        default:
+            break;
+    }
+}
+
+void storage_value_delete(struct storage_value * value) {
+    if (value) {
+        storage_value_destroy(*value);
+    }
+
+    free(value);
+}
+
+const char * storage_column_type_to_string(enum storage_column_type type) {
+    switch (type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            return "int";
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            return "uint";
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            return "num";
+
+        case STORAGE_COLUMN_TYPE_STR:
+            return "str";
+
+        default:
+            return NULL;
+    }
+}
+
+
+struct storage_joined_table * storage_joined_table_new(unsigned int amount) {
+    struct storage_joined_table * table = malloc(sizeof(*table));
+
+    table->tables.amount = amount;
+    table->tables.tables = calloc(amount, sizeof(*table->tables.tables));
+    table->rows.amount = 0;
+    table->rows.positions = NULL;
+    table->ranges.amount = 0;
+    table->ranges.ranges = NULL;
+    table->error = 0;
+
+    return table;
+}
+
+struct storage_joined_table * storage_joined_table_wrap(struct storage_table * table) {
+    if (!table) {
+        return NULL;
+    }
+
+    struct storage_joined_table * joined_table = storage_joined_table_new(1);
+    joined_table->tables.tables[0].table = table;
+    joined_table->tables.tables[0].t_column_index = 0;
+    joined_table->tables.tables[0].s_column_index = 0;
+
+    return joined_table;
+}
+
+void storage_joined_table_delete(struct storage_joined_table * table) {
+    if (table) {
+        for (unsigned int i = 0; i < table->tables.amount; ++i) {
+            storage_join_hash_delete(table->tables.tables[i].hash);
+        }
+
+        free(table->tables.tables);
+        free(table->rows.positions);
+        free(table->ranges.ranges);
+    }
+
+    free(table);
+}
+
+uint16_t storage_joined_table_get_columns_amount(struct storage_joined_table * table) {
+    uint16_t amount = 0;
 
     for (int i = 0; i < table->tables.amount; ++i) {
         amount += table->tables.tables[i].table->columns.amount;
     }
 
-    return amount;
+    return amount;
+}
+
+struct storage_column storage_joined_table_get_column(struct storage_joined_table * table, uint16_t index) {
+    for (int i = 0; i < table->tables.amount; ++i) {
+        if (index < table->tables.tables[i].table->columns.amount) {
+            return table->tables.tables[i].table->columns.columns[index];
+        }
+
+        index -= table->tables.tables[i].table->columns.amount;
+    }
+
+    abort();
+}
+
+static bool storage_value_is_equals(struct storage_value * a, struct storage_value * b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+
+    switch (a->type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            switch (b->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                    return a->value._int == b->value._int;
+
+                case STORAGE_COLUMN_TYPE_UINT:
+                    if (a->value._int < 0) {
+                        return false;
+                    }
+
+                    return ((uint64_t) a->value._int) == b->value.uint;
+
+                case STORAGE_COLUMN_TYPE_NUM:
+                    return ((double) a->value._int) == b->value.num;
+
+                case STORAGE_COLUMN_TYPE_STR:
+                    return false;
+            }
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            switch (b->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                    if (b->value._int < 0) {
+                        return false;
+                    }
+
+                    return a->value.uint == ((uint64_t) b->value._int);
+
+                case STORAGE_COLUMN_TYPE_UINT:
+                    return a->value.uint == b->value.uint;
+
+                case STORAGE_COLUMN_TYPE_NUM:
+                    return ((double) a->value.uint) == b->value.num;
+
+                case STORAGE_COLUMN_TYPE_STR:
+                    return false;
+            }
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            switch (b->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                    return a->value.num == ((double) b->value._int);
+
+                case STORAGE_COLUMN_TYPE_UINT:
+                    return a->value.num == ((double) b->value.uint);
+
+                case STORAGE_COLUMN_TYPE_NUM:
+                    return a->value.num == b->value.num;
+
+                case STORAGE_COLUMN_TYPE_STR:
+                    return false;
+            }
+
+        case STORAGE_COLUMN_TYPE_STR:
+            switch (b->type) {
+                case STORAGE_COLUMN_TYPE_INT:
+                case STORAGE_COLUMN_TYPE_UINT:
+                case STORAGE_COLUMN_TYPE_NUM:
+                    return false;
+
+                case STORAGE_COLUMN_TYPE_STR:
+                    return strcmp(a->value.str, b->value.str) == 0;
+            }
+    }
+}
+
+void storage_joined_table_set_positions(struct storage_joined_table * table, uint64_t * positions, size_t amount) {
+    free(table->rows.positions);
+
+    table->rows.amount = amount;
+    table->rows.positions = positions;
+}
+
+void storage_joined_table_set_ranges(struct storage_joined_table * table, struct storage_range * ranges, size_t amount) {
+    free(table->ranges.ranges);
+
+    table->ranges.amount = amount;
+    table->ranges.ranges = ranges;
+}
+
+// Converts the value to the type of the column for an equality lookup, returns 0 if no value of the type
+// is equal to it and -1 if values of the type can't be looked up by it
+static int storage_value_convert(const struct storage_value * value, enum storage_column_type type, struct storage_value * result) {
+    *result = *value;
+    result->type = type;
+
+    if (value->type == type) {
+        return 1;
+    }
+
+    switch (type) {
+        case STORAGE_COLUMN_TYPE_INT:
+            if (value->type == STORAGE_COLUMN_TYPE_UINT) {
+                result->value._int = (int64_t) value->value.uint;
+                return value->value.uint <= INT64_MAX ? 1 : 0;
+            }
+
+            // integers are compared with doubles after conversion, many of them can be equal to one double
+            return value->type == STORAGE_COLUMN_TYPE_NUM ? -1 : 0;
+
+        case STORAGE_COLUMN_TYPE_UINT:
+            if (value->type == STORAGE_COLUMN_TYPE_INT) {
+                result->value.uint = (uint64_t) value->value._int;
+                return value->value._int >= 0 ? 1 : 0;
+            }
+
+            return value->type == STORAGE_COLUMN_TYPE_NUM ? -1 : 0;
+
+        case STORAGE_COLUMN_TYPE_NUM:
+            if (value->type == STORAGE_COLUMN_TYPE_INT) {
+                result->value.num = (double) value->value._int;
+                return 1;
+            }
+
+            if (value->type == STORAGE_COLUMN_TYPE_UINT) {
+                result->value.num = (double) value->value.uint;
+                return 1;
+            }
+
+            return 0;
+
+        case STORAGE_COLUMN_TYPE_STR:
+            return 0;
+    }
+
+    return -1;
+}
+
+static uint64_t storage_join_hash_bytes(const void * data, size_t length) {
+    uint64_t hash = storage_hash_bytes(data, length);
+
+    // the hash of NULL values is reserved
+    return hash == STORAGE_JOIN_NULL_HASH ? hash + 1 : hash;
+}
+
+// Hashes the value of the type of the join column, values equal to each other have equal hashes
+static uint64_t storage_join_hash_value(const struct storage_value * value) {
+    switch (value->type) {
+        case STORAGE_COLUMN_TYPE_STR:
+            return storage_join_hash_bytes(value->value.str, strlen(value->value.str));
+
+        case STORAGE_COLUMN_TYPE_NUM:
+        {
+            // -0.0 is equal to 0.0
+            double num = value->value.num == 0 ? 0 : value->value.num;
+            return storage_join_hash_bytes(&num, sizeof(num));
+        }
+
+        default:
+            return storage_join_hash_bytes(&value->value, sizeof(uint64_t));
+    }
+}
+
+static uint64_t storage_join_hash_row(struct storage_row * row, uint16_t column) {
+    if (row->table->columns.columns[column].dictionary) {
+        uint64_t code;
+
+        if (!storage_row_get_code(row, column, &code)) {
+            return STORAGE_JOIN_NULL_HASH;
+        }
+
+        return storage_join_hash_bytes(&code, sizeof(code));
+    }
+
+    struct storage_value value;
+    if (!storage_row_read_value(row, column, &value)) {
+        return STORAGE_JOIN_NULL_HASH;
+    }
+
+    uint64_t hash = storage_join_hash_value(&value);
+    storage_value_destroy(value);
+    return hash;
+}
+
+static unsigned int storage_join_hash_partition(const struct storage_join_hash * hash, uint64_t key) {
+    return hash->bits == 0 ? 0 : (unsigned int) (key >> (64 - hash->bits));
+}
+
+static int storage_join_entry_compare(const void * a, const void * b) {
+    const struct storage_join_entry * left = a;
+    const struct storage_join_entry * right = b;
+
+    if (left->hash != right->hash) {
+        return left->hash < right->hash ? -1 : 1;
+    }
+
+    // rows with equal hashes are joined in the order of their positions
+    return left->position < right->position ? -1 : left->position > right->position;
 }
 
-struct storage_column storage_joined_table_get_column(struct storage_joined_table * table, uint16_t index) {
-    for (int i = 0; i < table->tables.amount; ++i) {
-        if (index < table->tables.tables[i].table->columns.amount) {
-            return table->tables.tables[i].table->columns.columns[index];
+static void storage_join_hash_delete(struct storage_join_hash * hash) {
+    if (hash) {
+        for (unsigned int i = 0; i < (1u << hash->bits); ++i) {
+            if (hash->partitions[i].file) {
+                fclose(hash->partitions[i].file);
+            }
         }
 
-        index -= table->tables.tables[i].table->columns.amount;
+        free(hash->partitions);
+        free(hash->entries);
     }
 
-    abort();
+    free(hash);
 }
 
-static bool storage_value_is_equals(struct storage_value * a, struct storage_value * b) {
-    if (a == NULL || b == NULL) {
-        return a == b;
+// Records the failure which ends the iteration over the joined table
+static void storage_joined_table_fail(struct storage_joined_table * table) {
+    // short reads of temporary files don't set errno
+    table->error = errno != 0 ? errno : EIO;
+    errno = table->error;
+}
+
+static void storage_join_files_close(FILE ** files, unsigned int amount) {
+    if (files) {
+        for (unsigned int i = 0; i < amount; ++i) {
+            if (files[i]) {
+                fclose(files[i]);
+            }
+        }
     }
 
-    switch (a->type) {
-        case STORAGE_COLUMN_TYPE_INT:
-            switch (b->type) {
-                case STORAGE_COLUMN_TYPE_INT:
-                    return a->value._int == b->value._int;
+    free(files);
+}
 
-                case STORAGE_COLUMN_TYPE_UINT:
-                    if (a->value._int < 0) {
-                        return false;
-                    }
+// Returns the index used to look up rows of the joined table or NULL if its join column has no index
+static struct storage_index * storage_joined_table_get_join_index(struct storage_joined_table * table, uint16_t index) {
+    struct storage_table * joined = table->tables.tables[index].table;
+    uint16_t column = table->tables.tables[index].t_column_index;
 
-                    return ((uint64_t) a->value._int) == b->value.uint;
+    struct storage_index * found = storage_table_get_index(joined, column, STORAGE_INDEX_TYPE_HASH);
+    if (!found) {
+        found = storage_table_get_index(joined, column, STORAGE_INDEX_TYPE_BTREE);
+    }
 
-                case STORAGE_COLUMN_TYPE_NUM:
-                    return ((double) a->value._int) == b->value.num;
+    return found;
+}
 
-                case STORAGE_COLUMN_TYPE_STR:
-                    return false;
-            }
+// Scans the rows of the table into a hash table of its column, returns NULL if the entries can't be spilled
+static struct storage_join_hash * storage_join_hash_build(struct storage_table * table, uint16_t column) {
+    struct storage_join_hash * hash = malloc(sizeof(*hash));
 
-        case STORAGE_COLUMN_TYPE_UINT:
-            switch (b->type) {
-                case STORAGE_COLUMN_TYPE_INT:
-                    if (b->value._int < 0) {
-                        return false;
-                    }
+    // partitions are planned by the amount of rows, so every one of them fits the memory budget
+    hash->bits = 0;
+    while (hash->bits < STORAGE_JOIN_MAX_PARTITION_BITS
+        && (table->stats.rows >> hash->bits) * sizeof(struct storage_join_entry) > STORAGE_JOIN_MEMORY) {
+        ++hash->bits;
+    }
 
-                    return a->value.uint == ((uint64_t) b->value._int);
+    hash->partitions = calloc(1u << hash->bits, sizeof(*hash->partitions));
+    hash->loaded = 0;
+    hash->amount = 0;
+    hash->entries = NULL;
 
-                case STORAGE_COLUMN_TYPE_UINT:
-                    return a->value.uint == b->value.uint;
+    for (unsigned int i = 0; i < (1u << hash->bits) && hash->bits > 0; ++i) {
+        hash->partitions[i].file = tmpfile();
 
-                case STORAGE_COLUMN_TYPE_NUM:
-                    return ((double) a->value.uint) == b->value.num;
+        if (!hash->partitions[i].file) {
+            storage_join_hash_delete(hash);
+            return NULL;
+        }
+    }
 
-                case STORAGE_COLUMN_TYPE_STR:
-                    return false;
+    size_t capacity = 0;
+    for (struct storage_row * row = storage_table_get_first_row(table); row; row = storage_row_next(row)) {
+        struct storage_join_entry entry = { .hash = storage_join_hash_row(row, column), .position = row->position };
+        unsigned int partition = storage_join_hash_partition(hash, entry.hash);
+
+        ++hash->partitions[partition].amount;
+
+        if (hash->partitions[partition].file) {
+            if (fwrite(&entry, sizeof(entry), 1, hash->partitions[partition].file) != 1) {
+                storage_row_delete(row);
+                storage_join_hash_delete(hash);
+                return NULL;
             }
 
-        case STORAGE_COLUMN_TYPE_NUM:
-            switch (b->type) {
-                case STORAGE_COLUMN_TYPE_INT:
-                    return a->value.num == ((double) b->value._int);
+            continue;
+        }
 
-                case STORAGE_COLUMN_TYPE_UINT:
-                    return a->value.num == ((double) b->value.uint);
+        if (hash->amount == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            hash->entries = realloc(hash->entries, sizeof(*hash->entries) * capacity);
+        }
 
-                case STORAGE_COLUMN_TYPE_NUM:
-                    return a->value.num == b->value.num;
+        hash->entries[hash->amount++] = entry;
+    }
 
-                case STORAGE_COLUMN_TYPE_STR:
-                    return false;
-            }
+    if (hash->bits == 0) {
+        qsort(hash->entries, hash->amount, sizeof(*hash->entries), storage_join_entry_compare);
+    } else {
+        // nothing is loaded yet
+        hash->loaded = 1u << hash->bits;
+    }
 
-        case STORAGE_COLUMN_TYPE_STR:
-            switch (b->type) {
-                case STORAGE_COLUMN_TYPE_INT:
-                case STORAGE_COLUMN_TYPE_UINT:
-                case STORAGE_COLUMN_TYPE_NUM:
-                    return false;
+    return hash;
+}
 
-                case STORAGE_COLUMN_TYPE_STR:
-                    return strcmp(a->value.str, b->value.str) == 0;
-            }
+// Loads the spilled partition in place of the loaded one, returns false if it can't be read
+static bool storage_join_hash_load(struct storage_join_hash * hash, unsigned int partition) {
+    if (hash->loaded == partition) {
+        return true;
+    }
+
+    FILE * file = hash->partitions[partition].file;
+    size_t amount = hash->partitions[partition].amount;
+
+    hash->entries = realloc(hash->entries, sizeof(*hash->entries) * (amount ? amount : 1));
+    hash->loaded = 1u << hash->bits;
+    hash->amount = 0;
+
+    errno = 0;
+    if (fflush(file) != 0 || fseek(file, 0, SEEK_SET) != 0 || fread(hash->entries, sizeof(*hash->entries), amount, file) != amount) {
+        return false;
+    }
+
+    qsort(hash->entries, amount, sizeof(*hash->entries), storage_join_entry_compare);
+    hash->loaded = partition;
+    hash->amount = amount;
+    return true;
+}
+
+// Returns positions of rows with the hash in the loaded partition
+static uint64_t * storage_join_hash_find(struct storage_join_hash * hash, uint64_t key, size_t * amount) {
+    size_t from = 0, to = hash->amount;
+    while (from < to) {
+        size_t middle = from + (to - from) / 2;
+
+        if (hash->entries[middle].hash < key) {
+            from = middle + 1;
+        } else {
+            to = middle;
+        }
+    }
+
+    *amount = 0;
+    while (from + *amount < hash->amount && hash->entries[from + *amount].hash == key) {
+        ++*amount;
+    }
+
+    uint64_t * positions = malloc(sizeof(*positions) * (*amount ? *amount : 1));
+    for (size_t i = 0; i < *amount; ++i) {
+        positions[i] = hash->entries[from + i].position;
+    }
+
+    return positions;
+}
+
+// Hashes the join value of the current rows of previous tables for the joined table, returns 0 if the value
+// is on no row and -1 if it can't be looked up by hashes
+static int storage_joined_row_hash(struct storage_joined_row * row, uint16_t index, uint64_t * key) {
+    struct storage_table * table = row->table->tables.tables[index].table;
+    uint16_t column = row->table->tables.tables[index].t_column_index;
+    struct storage_value value;
+
+    *key = STORAGE_JOIN_NULL_HASH;
+    if (!storage_joined_row_read_value(row, row->table->tables.tables[index].s_column_index, &value)) {
+        return 1;
+    }
+
+    struct storage_value converted;
+    int result = storage_value_convert(&value, table->columns.columns[column].type, &converted);
+
+    if (result == 1 && table->columns.columns[column].dictionary) {
+        uint64_t code;
+
+        // a string which is not in the dictionary is on no row
+        if (storage_table_find_code(table, column, converted.value.str, &code)) {
+            *key = storage_join_hash_bytes(&code, sizeof(code));
+        } else {
+            result = 0;
+        }
+    } else if (result == 1) {
+        *key = storage_join_hash_value(&converted);
+    }
+
+    storage_value_destroy(value);
+    return result;
+}
+
+// Looks up rows of the joined table which are on the current rows of previous tables by the hash table of its column,
+// leaves no positions if the value can't be looked up by hashes
+static void storage_joined_row_probe_hash(struct storage_joined_row * row, uint16_t index) {
+    struct storage_join_hash * hash = row->table->tables.tables[index].hash;
+    uint64_t key;
+    int result;
+
+    // partitioned combinations are read with their hashes, the ones which can't be hashed are in the last partition
+    if (row->partitioned.index == index) {
+        key = row->partitioned.hash;
+        result = row->partitioned.partition < (1u << hash->bits) ? 1 : -1;
+    } else {
+        result = storage_joined_row_hash(row, index, &key);
+    }
+
+    switch (result) {
+        case 1:
+            row->probes[index].positions = storage_join_hash_find(hash, key, &row->probes[index].amount);
+            break;
+
+        case 0:
+            row->probes[index].positions = malloc(sizeof(*row->probes[index].positions));
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Looks up rows of the joined table which are on the current rows of previous tables by an index of its column
+// or by the hash table of the column without an index
+static void storage_joined_row_probe(struct storage_joined_row * row, uint16_t index) {
+    struct storage_table * table = row->table->tables.tables[index].table;
+    uint16_t column = row->table->tables.tables[index].t_column_index;
+
+    free(row->probes[index].positions);
+    row->probes[index].positions = NULL;
+    row->probes[index].amount = 0;
+
+    struct storage_index * found = storage_joined_table_get_join_index(row->table, index);
+    if (!found) {
+        storage_joined_row_probe_hash(row, index);
+        return;
+    }
+
+    // NULL is on NULL, but NULL values are not indexed
+    struct storage_value value;
+    if (!storage_joined_row_read_value(row, row->table->tables.tables[index].s_column_index, &value)) {
+        return;
+    }
+
+    struct storage_value key;
+    switch (storage_value_convert(&value, table->columns.columns[column].type, &key)) {
+        case 1:
+            row->probes[index].positions = storage_index_find(found, &key, &key, &row->probes[index].amount);
+            break;
+
+        case 0:
+            row->probes[index].positions = malloc(sizeof(*row->probes[index].positions));
+            break;
+
+        default:
+            break;
+    }
+
+    storage_value_destroy(value);
+}
+
+static struct storage_row * storage_joined_row_first_at(struct storage_joined_row * row, uint16_t index) {
+    struct storage_joined_table * table = row->table;
+
+    if (index == 0) {
+        row->probes[0].positions = table->rows.positions;
+        row->probes[0].amount = table->rows.amount;
+    } else {
+        storage_joined_row_probe(row, index);
+    }
+
+    row->probes[index].position = 0;
+
+    if (!row->probes[index].positions) {
+        if (index == 0) {
+            return storage_table_get_first_row_in(table->tables.tables[0].table, table->ranges.ranges, table->ranges.amount);
+        }
+
+        return storage_table_get_first_row(table->tables.tables[index].table);
     }
+
+    if (row->probes[index].amount == 0) {
+        return NULL;
+    }
+
+    struct storage_row * first = malloc(sizeof(*first));
+    first->table = table->tables.tables[index].table;
+    first->position = row->probes[index].positions[0];
+    first->ranges.amount = 0;
+    first->ranges.ranges = NULL;
+    return first;
+}
+
+static struct storage_row * storage_joined_row_next_at(struct storage_joined_row * row, uint16_t index) {
+    if (!row->probes[index].positions) {
+        return storage_row_next(row->rows[index]);
+    }
+
+    if (++row->probes[index].position >= row->probes[index].amount) {
+        storage_row_delete(row->rows[index]);
+        return NULL;
+    }
+
+    row->rows[index]->position = row->probes[index].positions[row->probes[index].position];
+    return row->rows[index];
 }
 
 static bool storage_joined_row_is_on(struct storage_joined_row * row, uint16_t index) {
-    return storage_value_is_equals(
-        storage_joined_row_get_value(row, row->table->tables.tables[index].s_column_index),
-        storage_row_get_value(row->rows[index], row->table->tables.tables[index].t_column_index)
-    );
+    struct storage_table * table = row->table->tables.tables[index].table;
+    uint16_t column = row->table->tables.tables[index].t_column_index;
+    struct storage_value value;
+    bool found = storage_joined_row_read_value(row, row->table->tables.tables[index].s_column_index, &value);
+
+    // strings are looked up in the dictionary of the joined column and compared by codes
+    if (found && value.type == STORAGE_COLUMN_TYPE_STR && table->columns.columns[column].dictionary) {
+        uint64_t code, row_code;
+        bool equal = storage_table_find_code(table, column, value.value.str, &code)
+            && storage_row_get_code(row->rows[index], column, &row_code) && code == row_code;
+
+        storage_value_destroy(value);
+        return equal;
+    }
+
+    struct storage_value row_value;
+    bool row_found = storage_row_read_value(row->rows[index], column, &row_value);
+    bool equal = storage_value_is_equals(found ? &value : NULL, row_found ? &row_value : NULL);
+
+    if (row_found) {
+        storage_value_destroy(row_value);
+    }
+
+    if (found) {
+        storage_value_destroy(value);
+    }
+
+    return equal;
 }
 
-static void storage_joined_row_roll(struct storage_joined_row * row) {
-    for (int i = 1; i < row->table->tables.amount; ++i) {
-        if (!storage_joined_row_is_on(row, i)) {
-            row->rows[i] = storage_row_next(row->rows[i]);
+// Reads rows of the tables before the partitioned one at the positions of the next partitioned combination,
+// returns false after the last partition
+static bool storage_joined_row_next_partitioned(struct storage_joined_row * row) {
+    uint16_t index = row->partitioned.index;
+    struct storage_join_hash * hash = row->table->tables.tables[index].hash;
+    uint64_t record[index + 1];
+
+    while (row->partitioned.partition <= (1u << hash->bits)) {
+        FILE * file = row->partitioned.files[row->partitioned.partition];
+
+        errno = 0;
+        size_t was_read = fread(record, sizeof(*record), index + 1, file);
 
-            for (int j = i + 1; j < row->table->tables.amount; ++j) {
-                storage_row_delete(row->rows[j]);
-                row->rows[j] = storage_table_get_first_row(row->table->tables.tables[j].table);
+        if (was_read == index + 1) {
+            row->partitioned.hash = record[0];
+
+            for (uint16_t i = 0; i < index; ++i) {
+                row->rows[i]->position = record[i + 1];
             }
 
-            for (int j = i; j > 0; --j) {
-                if (row->rows[j] == NULL) {
-                    row->rows[j] = storage_table_get_first_row(row->table->tables.tables[j].table);
-                    row->rows[j - 1] = storage_row_next(row->rows[j - 1]);
-                }
+            return true;
+        }
+
+        if (was_read != 0 || ferror(file)) {
+            storage_joined_table_fail(row->table);
+            return false;
+        }
+
+        // the partition of the hash table is loaded once for all combinations of the partition
+        if (++row->partitioned.partition < (1u << hash->bits) && !storage_join_hash_load(hash, row->partitioned.partition)) {
+            storage_joined_table_fail(row->table);
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Moves rows of tables starting from the specified one to the next combination on which all tables up to the last one
+// are joined, returns false if there is no such combination
+static bool storage_joined_row_search(struct storage_joined_row * row, uint16_t index, uint16_t last_index) {
+    while (true) {
+        if (row->rows[index] == NULL && index == row->partitioned.index) {
+            if (index == 0 || !storage_joined_row_next_partitioned(row)) {
+                return false;
             }
 
-            if (row->rows[0] == NULL) {
-                return;
+            row->rows[index] = storage_joined_row_first_at(row, index);
+        } else if (row->rows[index] == NULL) {
+            --index;
+            row->rows[index] = storage_joined_row_next_at(row, index);
+        } else if (index > 0 && !storage_joined_row_is_on(row, index)) {
+            row->rows[index] = storage_joined_row_next_at(row, index);
+        } else if (index == last_index) {
+            return true;
+        } else {
+            ++index;
+            row->rows[index] = storage_joined_row_first_at(row, index);
+        }
+    }
+}
+
+// Moves rows of tables up to the last one to the first combination on which they are joined
+static bool storage_joined_row_first(struct storage_joined_row * row, uint16_t last_index) {
+    if (row->partitioned.index == 0) {
+        row->rows[0] = storage_joined_row_first_at(row, 0);
+    }
+
+    return storage_joined_row_search(row, row->partitioned.index, last_index);
+}
+
+// Drops rows of all tables and partitioned combinations
+static void storage_joined_row_reset(struct storage_joined_row * row) {
+    for (unsigned int i = 0; i < row->table->tables.amount; ++i) {
+        storage_row_delete(row->rows[i]);
+        row->rows[i] = NULL;
+
+        // positions of the first table belong to the joined table
+        if (i > 0) {
+            free(row->probes[i].positions);
+            row->probes[i].positions = NULL;
+            row->probes[i].amount = 0;
+        }
+    }
+
+    if (row->partitioned.files) {
+        struct storage_join_hash * hash = row->table->tables.tables[row->partitioned.index].hash;
+        storage_join_files_close(row->partitioned.files, (1u << hash->bits) + 1);
+    }
+
+    row->partitioned.index = 0;
+    row->partitioned.files = NULL;
+}
+
+// Writes all combinations of rows of the tables before the joined table with a spilled hash table to partitions
+// by hashes of their join values, then the combinations are read from them, returns false if they can't be written
+static bool storage_joined_row_partition(struct storage_joined_row * row, uint16_t index) {
+    struct storage_joined_table * table = row->table;
+    struct storage_join_hash * hash = table->tables.tables[index].hash;
+    unsigned int amount = (1u << hash->bits) + 1;
+    FILE ** files = calloc(amount, sizeof(*files));
+    uint64_t record[index + 1];
+
+    errno = 0;
+    bool written = true;
+    for (unsigned int i = 0; i < amount && written; ++i) {
+        files[i] = tmpfile();
+        written = files[i] != NULL;
+    }
+
+    // combinations are read from the partitions of a previous table if it is spilled too
+    bool found = written && storage_joined_row_first(row, index - 1);
+    while (found && written) {
+        int result = storage_joined_row_hash(row, index, &record[0]);
+
+        // combinations which are on no row are not written
+        if (result != 0) {
+            for (uint16_t i = 0; i < index; ++i) {
+                record[i + 1] = row->rows[i]->position;
             }
 
-            i = 0;
+            FILE * file = files[result > 0 ? storage_join_hash_partition(hash, record[0]) : amount - 1];
+            written = fwrite(record, sizeof(*record), index + 1, file) == index + 1;
         }
+
+        row->rows[index - 1] = storage_joined_row_next_at(row, index - 1);
+        found = storage_joined_row_search(row, index - 1, index - 1);
+    }
+
+    for (unsigned int i = 0; i < amount && written; ++i) {
+        written = fflush(files[i]) == 0 && fseek(files[i], 0, SEEK_SET) == 0;
+    }
+
+    if (!written) {
+        storage_joined_table_fail(table);
+    }
+
+    storage_joined_row_reset(row);
+
+    if (table->error != 0) {
+        storage_join_files_close(files, amount);
+        return false;
+    }
+
+    row->partitioned.index = index;
+    row->partitioned.files = files;
+    row->partitioned.partition = 0;
+
+    // rows of the previous tables are only moved to positions of the combinations
+    for (uint16_t i = 0; i < index; ++i) {
+        row->rows[i] = malloc(sizeof(*row->rows[i]));
+        row->rows[i]->table = table->tables.tables[i].table;
+        row->rows[i]->position = 0;
+        row->rows[i]->ranges.amount = 0;
+        row->rows[i]->ranges.ranges = NULL;
+    }
+
+    if (!storage_join_hash_load(hash, 0)) {
+        storage_joined_table_fail(table);
+        return false;
     }
+
+    return true;
 }
 
 struct storage_joined_row * storage_joined_table_get_first_row(struct storage_joined_table * table) {
     struct storage_joined_row * row = malloc(sizeof(*row));
 
     row->table = table;
-    row->rows = malloc(sizeof(struct storage_row *) * table->tables.amount);
-    for (int i = 0; i < table->tables.amount; ++i) {
-        row->rows[i] = NULL;
-    }
+    row->rows = calloc(table->tables.amount, sizeof(*row->rows));
+    row->probes = calloc(table->tables.amount, sizeof(*row->probes));
+    row->partitioned.index = 0;
+    row->partitioned.files = NULL;
+    row->partitioned.partition = 0;
+    row->partitioned.hash = 0;
+    table->error = 0;
+
+    // joined tables without indexes are hashed first, combinations of rows before a spilled one are partitioned
+    for (uint16_t i = 1; i < table->tables.amount; ++i) {
+        if (storage_joined_table_get_join_index(table, i)) {
+            continue;
+        }
 
-    for (int i = 0; i < table->tables.amount; ++i) {
-        row->rows[i] = storage_table_get_first_row(table->tables.tables[i].table);
+        if (!table->tables.tables[i].hash) {
+            errno = 0;
+            table->tables.tables[i].hash = storage_join_hash_build(table->tables.tables[i].table,
+                table->tables.tables[i].t_column_index);
+
+            if (!table->tables.tables[i].hash) {
+                storage_joined_table_fail(table);
+                storage_joined_row_delete(row);
+                return NULL;
+            }
+        }
 
-        if (row->rows[i] == NULL) {
+        if (table->tables.tables[i].hash->bits > 0 && !storage_joined_row_partition(row, i)) {
             storage_joined_row_delete(row);
             return NULL;
         }
     }
 
-    storage_joined_row_roll(row);
-    if (row->rows[0] == NULL) {
+    if (!storage_joined_row_first(row, table->tables.amount - 1)) {
         storage_joined_row_delete(row);
         return NULL;
     }
@@ -571,11 +4273,9 @@ struct storage_joined_row * storage_joined_table_get_first_row(struct storage_jo
 
 void storage_joined_row_delete(struct storage_joined_row * row) {
     if (row) {
-        for (int i = 0; i < row->table->tables.amount; ++i) {
-            storage_row_delete(row->rows[i]);
-        }
-
+        storage_joined_row_reset(row);
         free(row->rows);
+        free(row->probes);
     }
 
     free(row);
@@ -584,21 +4284,8 @@ void storage_joined_row_delete(struct storage_joined_row * row) {
 struct storage_joined_row * storage_joined_row_next(struct storage_joined_row * row) {
     uint16_t last_index = row->table->tables.amount - 1;
 
-    row->rows[last_index] = storage_row_next(row->rows[last_index]);
-    for (int i = (int) last_index; i > 0; --i) {
-        if (row->rows[i] == NULL) {
-            row->rows[i] = storage_table_get_first_row(row->table->tables.tables[i].table);
-            row->rows[i - 1] = storage_row_next(row->rows[i - 1]);
-        }
-    }
-
-    if (row->rows[0] == NULL) {
-        storage_joined_row_delete(row);
-        return NULL;
-    }
-
-    storage_joined_row_roll(row);
-    if (row->rows[0] == NULL) {
+    row->rows[last_index] = storage_joined_row_next_at(row, last_index);
+    if (!storage_joined_row_search(row, last_index, last_index)) {
         storage_joined_row_delete(row);
         return NULL;
     }
@@ -617,3 +4304,46 @@ struct storage_value * storage_joined_row_get_value(struct storage_joined_row *
 
     return NULL;
 }
+
+bool storage_joined_row_read_value(struct storage_joined_row * row, uint16_t index, struct storage_value * value) {
+    return storage_joined_row_read_value_in_arena(row, index, value, NULL);
+}
+
+bool storage_joined_row_read_value_in_arena(struct storage_joined_row * row, uint16_t index, struct storage_value * value, struct arena * arena) {
+    for (int i = 0; i < row->table->tables.amount; ++i) {
+        if (index < row->table->tables.tables[i].table->columns.amount) {
+            return storage_row_read_value_in_arena(row->rows[i], index, value, arena);
+        }
+
+        index -= row->table->tables.tables[i].table->columns.amount;
+    }
+
+    errno = EINVAL;
+    return false;
+}
+
+bool storage_joined_row_get_code(struct storage_joined_row * row, uint16_t index, uint64_t * code) {
+    for (int i = 0; i < row->table->tables.amount; ++i) {
+        if (index < row->table->tables.tables[i].table->columns.amount) {
+            return storage_row_get_code(row->rows[i], index, code);
+        }
+
+        index -= row->table->tables.tables[i].table->columns.amount;
+    }
+
+    errno = EINVAL;
+    return false;
+}
+
+bool storage_joined_table_find_code(struct storage_joined_table * table, uint16_t index, const char * str, uint64_t * code) {
+    for (int i = 0; i < table->tables.amount; ++i) {
+        if (index < table->tables.tables[i].table->columns.amount) {
+            return storage_table_find_code(table->tables.tables[i].table, index, str, code);
+        }
+
+        index -= table->tables.tables[i].table->columns.amount;
+    }
+
+    errno = EINVAL;
+    return false;
+}
@@ -1,6 +1,17 @@
 #pragma once
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pager.h"
+#include "arena.h"
+
+#define STORAGE_STATS_SKETCH_SIZE 256
+#define STORAGE_JOIN_MEMORY (64 * 1024 * 1024)
+#define STORAGE_JOIN_MAX_PARTITION_BITS 8
+#define STORAGE_JOIN_NULL_HASH 0
 
 // Pointer structure:
 // - Offset from start of file: <uint64_t>
@@ -9,20 +20,36 @@
 // - Length of string: <uint16_t>
 // - Value: <int8_t[]>
 //
+// All offsets are resolved through the page cache (see pager.h), changes reach
+// the file through its write-ahead log, one transaction per storage_flush.
+//
 // Storage file structure:
 // - Storage file header
-// - Table headers and rows
+// - Pages of PAGER_PAGE_SIZE bytes: table headers, data pages and string blobs
 //
-// Storage file header structure:
+// Storage file header structure (first page):
 // - Signature: 0xdeadbabe
+// - Version: <uint32_t>
 // - First table: <pointer>
+// - Amount of pages: <uint64_t>
+// - First page of free space map: <pointer>
 //
-// Table header structure:
+// Free space map page structure:
+// - Next page of free space map: <pointer>
+// - Bitmap: <uint8_t[]>, bit is set if the page is free, n-th map page covers
+//   pages from n * (PAGER_PAGE_SIZE - 8) * 8
+//
+// Table header structure (one page):
 // - Next table: <pointer>
-// - First row: <pointer>
+// - First data page: <pointer>
+// - Last data page: <pointer>
+// - First data page with free space: <pointer>
+// - First index: <pointer>
+// - Stats: <pointer>
 // - Table name: <string>
 // - Amount of table columns: <uint16_t>
 // - Table columns
+// - Table format: <uint8_t>, 0 - rows in data pages, 1 - columns in segments
 //
 // Table column structure:
 // - Column name: <string>
@@ -31,13 +58,144 @@
 //   - 1 - <uint64_t>
 //   - 2 - <double>
 //   - 3 - <string>
+// - Flags: <uint8_t>, 1 - strings are encoded with a dictionary
+// - First page of the dictionary, only for dictionary columns: <pointer>
+//
+// Dictionary page structure (same header as segment string pages):
+// - Next dictionary page: <pointer>
+// - Used bytes: <uint16_t>
+// - Reserved: <uint16_t[3]>
+// - Strings: { length: <uint16_t>, value: <int8_t[]> or first page of blob for long strings: <pointer> }[]
+// The code of a string is its number in the dictionary. Cells of dictionary columns keep
+// the code as <uint64_t> instead of the string, codes are never removed or reused. All
+// strings of a dictionary are kept in memory with a hash map from strings to codes, so
+// values are read without touching string pages and equal strings have equal codes.
+//
+// Data page structure:
+// - Next data page: <pointer>
+// - Previous data page: <pointer>
+// - Next data page with free space: <pointer>
+// - Previous data page with free space: <pointer>
+// - Amount of slots: <uint16_t>
+// - Start of records heap: <uint16_t>
+// - Length of removed records in heap: <uint16_t>
+// - Flags: <uint16_t>, 1 - page is in the list of pages with free space
+// - Slots: { offset of record in page (0 if free): <uint16_t>, length of record: <uint16_t> }[]
+// - Free space
+// - Records heap, growing from the end of page
 //
-// Table row structure:
-// - Next row: <pointer>
-// - Cells: <pointer[]>
+// Row (record) structure, aligned by 8 bytes:
+// - Cells: <uint64_t[]>
+// - Null bitmap: <uint8_t[(amount of columns + 7) / 8]>, bit is set if cell is NULL
+// - Values of inline strings
 //
 // Cell structure:
-// - Value: value of type that noticed in table header column
+// - <int64_t>/<uint64_t>/<double> value stored inline
+// - for strings: { offset in record (0 if stored in blob): <uint16_t>, length: <uint16_t>, first page of blob: <uint32_t> }
+//
+// Row position is the pointer to its data page plus the slot index.
+// Numbers are read straight from their cells, storage_row_read_value fills a value of
+// the caller and allocates nothing but the copy of a string. storage_row_read_value_in_arena
+// copies strings into the arena instead, such values are released with the arena and
+// must not be destroyed.
+// A new row is built with all its values and copied to its page at once, strings
+// are kept inline while the whole record fits an empty data page.
+//
+// Columnar tables keep their rows in segments instead of data pages, the first and the
+// last data page pointers of the table header point to segments. A segment is a run of
+// 1 + amount of columns pages allocated at once:
+// - Header page: { next segment: <pointer>, previous segment: <pointer>, first string page: <pointer>,
+//   amount of rows: <uint16_t>, amount of live rows: <uint16_t>, reserved: <uint32_t> },
+//   then the bitmap of live rows and a null bitmap for every column, STORAGE_SEGMENT_ROWS bits each,
+//   then the zone map of every column: { min: <cell>, max: <cell> }
+// - Column pages: cells of the column for STORAGE_SEGMENT_ROWS rows, strings refer to
+//   the string pages of the segment instead of the record
+// - String page: { next string page: <pointer>, used bytes: <uint16_t>, reserved: <uint16_t[3]> },
+//   then values of strings, the first page of a string cell is the string page
+// Rows are appended to the last segment and their slots are never reused, a removed row
+// only clears its live bit. The segment whose last row is removed is unlinked and freed
+// like an empty data page. A scan of one column reads only the pages of that column.
+// Zone maps of numeric columns are widened by every written value except NaN and rebuilt by vacuum,
+// a scan with ranges of values skips the segments whose zone maps are out of them. NaN satisfies
+// no range (a where compares it as unordered), so it is never needed to keep a segment.
+//
+// Table stats structure (consecutive pages):
+// - Amount of rows: <uint64_t>
+// - Columns: { amount of NULL values: <uint64_t>, min and max are set: <uint64_t>,
+//   min: <cell>, max: <cell>, sketch: <uint8_t[STORAGE_STATS_SKETCH_SIZE]> }[]
+// Stats are kept in memory, updated by every change of rows and written on storage_flush.
+// Min and max are kept only for numbers, the sketch is a HyperLogLog estimate of the
+// amount of distinct values. Removed values don't shrink min, max and the sketch, so they
+// are bounds until the table is vacuumed and its stats are counted again.
+//
+// Index header structure (one page):
+// - Next index of the table: <pointer>
+// - Root node of B+tree or hash directory: <pointer>
+// - Column index: <uint16_t>
+// - Index type: <uint8_t>, 0 - B+tree, 1 - hash
+// - Global depth of hash directory: <uint8_t>
+// - Index name: <string>
+//
+// B+tree node structure (one page):
+// - Next leaf for leaves, first child for inner nodes: <pointer>
+// - Is leaf: <uint16_t>
+// - Amount of items: <uint16_t>
+// - Reserved: <uint32_t>
+// - Leaf items: entries, sorted
+// - Inner node items: { entry, child with entries not less than it: <pointer> }[], sorted
+//
+// Index entry structure, compared with memcmp:
+// - Key: 8 bytes for numbers, first 24 bytes of the string padded with zeros for strings,
+//   integers and doubles are transformed to keep their order as big endian unsigned numbers
+// - Row position: <uint64_t>, big endian
+//
+// Hash index is an extendible hash table:
+// - Directory: <pointer[1 << global depth]> in consecutive pages, slot is the low bits of hash
+// - Bucket page: { next overflow page: <pointer>, local depth: <uint16_t>, amount of entries: <uint16_t>,
+//   reserved: <uint32_t> }, then { hash of the value: <uint64_t>, row position: <uint64_t> }[]
+// A full bucket is split by the next bit of hashes, the directory is doubled when
+// the local depth reaches the global one. Buckets of equal hashes get overflow pages.
+//
+// NULL values are not indexed. Entries are removed from leaves and buckets without
+// merging, indexes are rebuilt on vacuum. Strings are compared by prefix and hashes
+// may collide, so rows found by an index must be checked against the condition again.
+//
+// Blob structure (strings that don't fit into the data page):
+// - Value: <int8_t[]> in consecutive pages
+//
+// Pages of removed tables, blobs of removed or overwritten values are marked
+// in the free space map and reused before the file is extended. Data pages
+// with a quarter of free space are linked into the list of their table.
+// Both lists are doubly linked, so a data page whose last row is removed is
+// unlinked and freed at once. The freed page keeps its next pointer until it
+// is allocated again, which lets a cursor standing on it move to the next row.
+// DELETE without a condition frees all data pages of the table instead.
+//
+// Table headers are loaded once into the catalog of the storage, a hash map by
+// table name. Tables returned by storage_find_table are owned by the catalog,
+// storage_table_add moves the table into it and storage_table_remove frees it.
+//
+// Vacuum copies live rows of a table to consecutive new data pages in scan order,
+// switches the table header to them and frees old pages. Row positions change.
+// Columnar tables are vacuumed by appending their live rows to new segments.
+//
+// Joins:
+// - Rows of a joined table are found by an index of its join column for every
+//   combination of rows of the previous tables, if the column has one
+// - Otherwise the joined table is scanned once before the first row into a hash table
+//   of entries { hash of the value: <uint64_t>, row position: <uint64_t> }, NULL values
+//   get STORAGE_JOIN_NULL_HASH and values of dictionary columns are hashed by codes
+// - Entries are split into partitions by the high bits of hashes, so that a partition
+//   fits STORAGE_JOIN_MEMORY bytes. A single partition is kept in memory, more of them
+//   are spilled to temporary files
+// - If the hash table is spilled, all combinations of rows of the previous tables are
+//   partitioned by the same bits of hashes of their join values into temporary files
+//   of records { hash: <uint64_t>, positions of rows: <uint64_t>[] } first. Then the
+//   partitions are joined one by one, so every partition of the hash table is loaded once.
+//   Combinations whose values can't be hashed are joined by scans after all partitions
+// - Loaded entries are sorted by hashes and found by a binary search
+// Found rows are only candidates, every one of them is compared with the value again.
+// Rows of joins with spilled hash tables are ordered by partitions, not by previous tables.
 
 static const char * const JOINED_TABLE_NAME = "joined table";
 
@@ -48,14 +206,76 @@ enum storage_column_type {
     STORAGE_COLUMN_TYPE_STR = 3,
 };
 
+// All state of the storage is kept here, in its tables and in its pager. Nothing is locked, so
+// storage functions (reads of rows too) must be called by one thread at a time.
 struct storage {
+    // the file is only accessed by the pager at explicit offsets
     int fd;
+    struct pager * pager;
     uint64_t first_table;
+
+    // copy of the free space map, changed by allocations and frees of pages
+    struct {
+        size_t amount;
+        uint64_t * pages;
+        // amount of free pages and the first bit that may be set
+        uint64_t free;
+        uint64_t hint;
+    } free_space_map;
+
+    // catalog of tables by names, changed by creating and dropping tables
+    struct {
+        size_t amount;
+        size_t size;
+        struct storage_table ** buckets;
+    } tables;
+};
+
+enum storage_table_format {
+    STORAGE_TABLE_FORMAT_ROWS = 0,
+    STORAGE_TABLE_FORMAT_COLUMNS = 1,
 };
 
 struct storage_column {
     char * name;
     enum storage_column_type type;
+    bool dictionary;
+};
+
+struct storage_value {
+    enum storage_column_type type;
+
+    union {
+        int64_t _int;
+        uint64_t uint;
+        double num;
+        char * str;
+    } value;
+};
+
+struct storage_column_stats {
+    uint64_t nulls;
+    bool bounded;
+    struct storage_value min;
+    struct storage_value max;
+    uint8_t sketch[STORAGE_STATS_SKETCH_SIZE];
+};
+
+struct storage_dictionary {
+    uint64_t first_page;
+    uint64_t last_page;
+
+    // strings by codes
+    struct {
+        uint32_t amount;
+        char ** strings;
+    } codes;
+
+    // open addressing hash map of codes plus one by strings, 0 is an empty slot
+    struct {
+        size_t size;
+        uint32_t * slots;
+    } map;
 };
 
 struct storage_table {
@@ -64,31 +284,93 @@ struct storage_table {
     uint64_t position;
     uint64_t next;
 
-    uint64_t first_row;
+    uint64_t first_page;
+    uint64_t last_page;
+    uint64_t free_page;
     char * name;
 
     struct {
         uint16_t amount;
         struct storage_column * columns;
     } columns;
+
+    enum storage_table_format format;
+    // dictionaries of columns, NULL for columns without one
+    struct storage_dictionary ** dictionaries;
+
+    struct {
+        uint64_t position;
+        uint64_t rows;
+        bool dirty;
+        struct storage_column_stats * columns;
+    } stats;
+
+    uint64_t first_index;
+    struct {
+        uint16_t amount;
+        struct storage_index ** indexes;
+    } indexes;
+
+    struct storage_table * next_in_bucket;
 };
 
-struct storage_row {
+enum storage_index_type {
+    STORAGE_INDEX_TYPE_BTREE = 0,
+    STORAGE_INDEX_TYPE_HASH = 1,
+};
+
+struct storage_index {
     struct storage_table * table;
 
     uint64_t position;
     uint64_t next;
+    uint64_t root;
+
+    char * name;
+    uint16_t column;
+    enum storage_index_type type;
+    uint8_t depth;
 };
 
-struct storage_value {
-    enum storage_column_type type;
+// Inclusive range of values of a column, a scan may skip rows which are out of it
+struct storage_range {
+    uint16_t column;
+    bool has_from;
+    bool has_to;
+    struct storage_value from;
+    struct storage_value to;
+};
 
-    union {
-        int64_t _int;
-        uint64_t uint;
-        double num;
-        char * str;
-    } value;
+struct storage_row {
+    struct storage_table * table;
+
+    uint64_t position;
+
+    // ranges of the scan, segments whose zone maps are out of any of them are skipped
+    struct {
+        size_t amount;
+        const struct storage_range * ranges;
+    } ranges;
+};
+
+struct storage_join_entry {
+    uint64_t hash;
+    uint64_t position;
+};
+
+struct storage_join_hash {
+    uint8_t bits;
+
+    // partitions by the high bits of hashes, files are NULL if all entries are kept in memory
+    struct {
+        FILE * file;
+        size_t amount;
+    } * partitions;
+
+    // entries of the loaded partition
+    unsigned int loaded;
+    size_t amount;
+    struct storage_join_entry * entries;
 };
 
 struct storage_joined_table {
@@ -98,20 +380,57 @@ struct storage_joined_table {
             struct storage_table * table;
             uint16_t t_column_index;
             uint16_t s_column_index;
+
+            // built before the first row if the join column has no index
+            struct storage_join_hash * hash;
         } * tables;
     } tables;
+
+    // positions of rows of the first table to iterate over instead of all its rows
+    struct {
+        size_t amount;
+        uint64_t * positions;
+    } rows;
+
+    // ranges of values of columns of the first table which all rows of the result are in
+    struct {
+        size_t amount;
+        struct storage_range * ranges;
+    } ranges;
+
+    // errno of the failure which ended the last iteration early, 0 if all rows were iterated
+    int error;
 };
 
 struct storage_joined_row {
     struct storage_joined_table * table;
     struct storage_row ** rows;
+
+    // rows of joined tables found by their indexes for the current rows of previous tables
+    struct {
+        size_t amount;
+        size_t position;
+        uint64_t * positions;
+    } * probes;
+
+    // combinations of rows of the tables before the joined table with a spilled hash table,
+    // read partition by partition instead of iterating over the tables, the index is 0 if there are none
+    struct {
+        uint16_t index;
+        FILE ** files;
+        unsigned int partition;
+        uint64_t hash;
+    } partitioned;
 };
 
 // storage
 
-struct storage * storage_init(int fd);
-struct storage * storage_open(int fd);
+struct storage * storage_init(int fd, int wal_fd, enum pager_mode mode, enum pager_durability durability, size_t cache_size);
+struct storage * storage_open(int fd, int wal_fd, enum pager_mode mode, enum pager_durability durability, size_t cache_size);
 void storage_delete(struct storage * storage);
+void storage_flush(struct storage * storage);
+void storage_checkpoint(struct storage * storage);
+void storage_vacuum(struct storage * storage);
 
 struct storage_table * storage_find_table(struct storage * storage, const char * name);
 
@@ -121,8 +440,23 @@ void storage_table_delete(struct storage_table * table);
 
 void storage_table_add(struct storage_table * table);
 void storage_table_remove(struct storage_table * table);
+uint64_t storage_table_truncate(struct storage_table * table);
+void storage_table_vacuum(struct storage_table * table);
+struct storage_index * storage_table_add_index(struct storage_table * table, const char * name, uint16_t column, enum storage_index_type type);
+struct storage_index * storage_table_get_index(struct storage_table * table, uint16_t column, enum storage_index_type type);
 struct storage_row * storage_table_get_first_row(struct storage_table * table);
-struct storage_row * storage_table_add_row(struct storage_table * table);
+struct storage_row * storage_table_get_first_row_in(struct storage_table * table, const struct storage_range * ranges, size_t amount);
+bool storage_table_check_row(struct storage_table * table, struct storage_value ** values);
+struct storage_row * storage_table_add_row(struct storage_table * table, struct storage_value ** values);
+bool storage_table_find_code(struct storage_table * table, uint16_t index, const char * str, uint64_t * code);
+
+// storage_column_stats
+
+uint64_t storage_column_stats_distinct(const struct storage_column_stats * stats);
+
+// storage_index
+
+uint64_t * storage_index_find(struct storage_index * index, struct storage_value * from, struct storage_value * to, size_t * amount);
 
 // storage_row
 
@@ -131,7 +465,11 @@ void storage_row_delete(struct storage_row * row);
 struct storage_row * storage_row_next(struct storage_row * row);
 void storage_row_remove(struct storage_row * row);
 struct storage_value * storage_row_get_value(struct storage_row * row, uint16_t index);
+bool storage_row_read_value(struct storage_row * row, uint16_t index, struct storage_value * value);
+bool storage_row_read_value_in_arena(struct storage_row * row, uint16_t index, struct storage_value * value, struct arena * arena);
+bool storage_row_get_code(struct storage_row * row, uint16_t index, uint64_t * code);
 void storage_row_set_value(struct storage_row * row, uint16_t index, struct storage_value * value);
+void storage_row_set_values(struct storage_row * row, unsigned int amount, const unsigned int * indexes, struct storage_value ** values);
 
 // storage_value
 
@@ -150,6 +488,9 @@ void storage_joined_table_delete(struct storage_joined_table * table);
 
 uint16_t storage_joined_table_get_columns_amount(struct storage_joined_table * table);
 struct storage_column storage_joined_table_get_column(struct storage_joined_table * table, uint16_t index);
+bool storage_joined_table_find_code(struct storage_joined_table * table, uint16_t index, const char * str, uint64_t * code);
+void storage_joined_table_set_positions(struct storage_joined_table * table, uint64_t * positions, size_t amount);
+void storage_joined_table_set_ranges(struct storage_joined_table * table, struct storage_range * ranges, size_t amount);
 struct storage_joined_row * storage_joined_table_get_first_row(struct storage_joined_table * table);
 
 // storage_json_row
@@ -158,3 +499,7 @@ void storage_joined_row_delete(struct storage_joined_row * row);
 
 struct storage_joined_row * storage_joined_row_next(struct storage_joined_row * row);
 struct storage_value * storage_joined_row_get_value(struct storage_joined_row * row, uint16_t index);
+bool storage_joined_row_read_value(struct storage_joined_row * row, uint16_t index, struct storage_value * value);
+bool storage_joined_row_read_value_in_arena(struct storage_joined_row * row, uint16_t index, struct storage_value * value,
+    struct arena * arena);
+bool storage_joined_row_get_code(struct storage_joined_row * row, uint16_t index, uint64_t * code);